@@ -0,0 +1,43 @@
+/* PCC is developed on 4.15. The differences of the later kernels it builds
+ * against are kept here, in the 4.15 names the rest of the code uses.
+ */
+#ifndef _PCC_COMPAT_H
+#define _PCC_COMPAT_H
+
+#include <linux/version.h>
+
+/* cong_control() is passed the ack and its flags since 6.10, see
+ * pcc_cong_control() */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 10, 0)
+#define PCC_CONG_CONTROL_ACK
+#endif
+
+/* The TSO size hook gives the size itself before 4.20. Since, it is only a
+ * minimum to the stack's own size of sk_pacing_rate >> sk_pacing_shift. See
+ * pcc_tso_segs() */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 20, 0)
+#define PCC_MIN_TSO_SEGS
+#endif
+
+/* snd_cwnd is only accessed through helpers since 5.19 */
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 19, 0)
+static inline u32 tcp_snd_cwnd(const struct tcp_sock *tp)
+{
+	return tp->snd_cwnd;
+}
+
+static inline void tcp_snd_cwnd_set(struct tcp_sock *tp, u32 val)
+{
+	tp->snd_cwnd = val;
+}
+#endif
+
+/* prandom_u32() was dropped in 6.2, get_random_u32() is just as cheap since
+ * 6.1 (per cpu batched) */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 1, 0)
+#define pcc_random_u32() get_random_u32()
+#else
+#define pcc_random_u32() prandom_u32()
+#endif
+
+#endif /* _PCC_COMPAT_H */
@@ -0,0 +1,893 @@
+/* PCC core: the Allegro and Vivace utilities of an interval, the tables they
+ * are calculated with and the noise of their comparisons, and the decisions
+ * taken on them - slow start, the pairs of decision making and their votes,
+ * epsilon, rate adjustment - over struct pcc_state. They only take numbers, so
+ * the same code builds in userspace (see tools/pcc_sim/). The includer provides
+ * the kernel types and helpers: linux/kernel.h and linux/math64.h in the
+ * kernel, tools/pcc_sim/kernel.h in userspace, and sends and receives the
+ * intervals. Call pcc_sigmoid_init() and pcc_pow2_init() before any utility.
+ */
+#ifndef _PCC_CORE_H
+#define _PCC_CORE_H
+
+/* The parameters that can be tuned at runtime through the module parameters
+ * (/sys/module/tcp_pcc/parameters/), see pcc_param_set() in tcp_pcc.c. A write
+ * is checked against the others before it is taken, so flows always see a
+ * valid set */
+struct pcc_params {
+	/* Ignore the first and last packets of every interval because they
+	 * might contain data of the previous / next interval. */
+	u32 ignore_packets;
+
+	/* Interval should have a minimal number of segs, otherwise, it is not
+	 * possible to calculate stats about it. This length include two ignore
+	 * part, one in the beginning and one in the end. It limits the interval
+	 * data to at least 20 segs, which gives the ability to notice 5% loss */
+	u32 interval_min_segs;
+
+	/* Epsilon is between 1% to 5%, and in granularity of 1% */
+	u32 epsilon_min;
+	u32 epsilon_max;
+
+	/* PCC allows for 5% loss before drastic utility decreasment */
+	u32 loss_margin;
+	/* PCC utility function const: alpha parameter for the sigmoid
+	 * function */
+	u32 alpha;
+
+	/* New flows start at the rate of their initial window over the
+	 * handshake RTT, and at least at initial_rate */
+	u32 initial_rate;	/* in bytes/sec */
+
+	/* How long the rate of a closed flow is kept for the next flows to its
+	 * destination, in seconds. 0 keeps nothing, see pcc_dst_rate() */
+	u32 dst_cache_timeout;
+
+	/* Flows of a namespace to the same destination share their path, see
+	 * pcc_path_join(). 0 or 1 */
+	u32 path_share;
+};
+
+/* Rates are kept in units of PCC_RATE_UNIT bytes/sec, so they fit in u32 up to
+ * ~500Gbps */
+#define PCC_RATE_SHIFT 4
+#define PCC_RATE_UNIT (1 << PCC_RATE_SHIFT)
+
+/* PCC utility function rounding factor. The utility function is rounded up to 
+ * 1/pcc_rounding_factor */
+static const u32 pcc_rounding_factor = 1000;
+
+/* Limit the input sent to calculate sigmoid on, to avoid long calculation that
+ * will result in zero */
+static const u32 pcc_max_loss = 10;
+
+/* The sigmoid 1 / (1 + e^x) of the utility function is taken from a table,
+ * with linear interpolation. x is in 1/pcc_rounding_factor, the table covers
+ * +-pcc_max_loss in steps of 2^PCC_SIGMOID_STEP_SHIFT and holds the sigmoid
+ * in 1/2^PCC_SIGMOID_SHIFT */
+#define PCC_SIGMOID_SHIFT 15
+#define PCC_SIGMOID_STEP_SHIFT 6
+#define PCC_SIGMOID_LIMIT 10000 /* pcc_max_loss * pcc_rounding_factor */
+#define PCC_SIGMOID_ENTRIES ((2 * PCC_SIGMOID_LIMIT >> PCC_SIGMOID_STEP_SHIFT) + 2)
+
+/* Loss ratios are in 1/2^PCC_LOSS_SHIFT */
+#define PCC_LOSS_SHIFT 16
+
+/* PCC Vivace utility function:
+ * util = x^0.9 - 900 * x * d(RTT)/dt - 11.35 * x * loss_rate, x in Mbps.
+ * Vivace rates and utilities are in 1/2^PCC_VIVACE_SHIFT Mbps */
+#define PCC_VIVACE_SHIFT 10
+static const u32 pcc_vivace_exponent = 900;	/* in 1/1000 */
+static const u32 pcc_vivace_latency_coef = 900;
+static const u32 pcc_vivace_loss_coef = 1135;	/* in 1/100 */
+
+/* Slow start and rate adjustment only take a utility as lower than the one
+ * before it when it is below by more than pcc_utility_confidence deviations of
+ * its noise, see pcc_utility_noise() */
+static const u32 pcc_utility_confidence = 2;
+
+/* RTT gradients are in 1/2^PCC_GRADIENT_SHIFT usecs per usec */
+#define PCC_GRADIENT_SHIFT 16
+
+/* 2^x is taken from a table of the fractions of x, in steps of
+ * 2^-PCC_POW2_STEP_SHIFT. PCC_POW2_STEP is 2^(2^-PCC_POW2_STEP_SHIFT) in
+ * 1/2^30 */
+#define PCC_POW2_STEP_SHIFT 6
+#define PCC_POW2_ENTRIES ((1 << PCC_POW2_STEP_SHIFT) + 1)
+#define PCC_POW2_STEP 1085434106
+
+static inline u64 pcc_rate_bytes(u32 rate)
+{
+	return (u64)rate << PCC_RATE_SHIFT;
+}
+
+/* get x = number * pcc_rounding_factor, return 
+ * (e ^ number) * pcc_rounding_factor
+ * Only used at load time, to build the sigmoid table.
+ */
+static u32 __init pcc_exp(s32 x)
+{
+	s64 temp = pcc_rounding_factor;
+	s64 exp = pcc_rounding_factor;
+	int i;
+
+	for (i = 1; temp != 0; i++) {
+		temp *= x;
+		temp /= i;
+		temp /= pcc_rounding_factor;
+		exp += temp;
+	}
+	return exp;
+}
+
+static u16 pcc_sigmoid_table[PCC_SIGMOID_ENTRIES] __read_mostly;
+
+/* 1 / (1 + e^x) in 1/2^PCC_SIGMOID_SHIFT, as the utility used to calculate it */
+static u32 __init pcc_sigmoid_taylor(s32 x)
+{
+	u64 sigmoid = (u64)pcc_rounding_factor << PCC_SIGMOID_SHIFT;
+
+	return div_u64(sigmoid, pcc_exp(x) + pcc_rounding_factor);
+}
+
+/* The series loses precision for negative x, so use sigmoid(x) = 1 -
+ * sigmoid(-x) there. That is within 15/2^PCC_SIGMOID_SHIFT of the real
+ * sigmoid over the table */
+static u32 __init pcc_sigmoid_series(s32 x)
+{
+	if (x < 0)
+		return (1 << PCC_SIGMOID_SHIFT) - pcc_sigmoid_taylor(-x);
+	return pcc_sigmoid_taylor(x);
+}
+
+static void __init pcc_sigmoid_init(void)
+{
+	s32 x;
+	int i;
+
+	for (i = 0; i < PCC_SIGMOID_ENTRIES; i++) {
+		x = (i << PCC_SIGMOID_STEP_SHIFT) - PCC_SIGMOID_LIMIT;
+		pcc_sigmoid_table[i] = pcc_sigmoid_series(x);
+	}
+}
+
+/* Constant time 1 / (1 + e^x), x in 1/pcc_rounding_factor */
+static inline u32 pcc_sigmoid(s32 x)
+{
+	s32 low, high, frac;
+	u32 index;
+
+	x = clamp_t(s32, x, -PCC_SIGMOID_LIMIT, PCC_SIGMOID_LIMIT - 1);
+	x += PCC_SIGMOID_LIMIT;
+	index = x >> PCC_SIGMOID_STEP_SHIFT;
+	frac = x & ((1 << PCC_SIGMOID_STEP_SHIFT) - 1);
+
+	low = pcc_sigmoid_table[index];
+	high = pcc_sigmoid_table[index + 1];
+	return low + (((high - low) * frac) >> PCC_SIGMOID_STEP_SHIFT);
+}
+
+static u32 pcc_pow2_table[PCC_POW2_ENTRIES] __read_mostly;
+
+static void __init pcc_pow2_init(void)
+{
+	int i;
+
+	pcc_pow2_table[0] = 1 << 30;
+	for (i = 1; i < PCC_POW2_ENTRIES; i++)
+		pcc_pow2_table[i] = ((u64)pcc_pow2_table[i - 1] *
+				     PCC_POW2_STEP) >> 30;
+}
+
+/* log2(x) in 1/2^16, x > 0 */
+static inline u32 pcc_log2(u64 x)
+{
+	int i, msb = fls64(x) - 1;
+	u32 log = msb << 16;
+	u64 y;
+
+	/* y = x / 2^msb in 1/2^31, squaring it gives the next bit */
+	y = msb > 31 ? x >> (msb - 31) : x << (31 - msb);
+	for (i = 15; i >= 0; i--) {
+		y = (y * y) >> 31;
+		if (y >= 2ULL << 31) {
+			y >>= 1;
+			log |= 1 << i;
+		}
+	}
+	return log;
+}
+
+/* 2^x, x in 1/2^16 */
+static inline u64 pcc_pow2(u32 x)
+{
+	u32 frac = x & 0xffff, index, low, high, pow;
+
+	index = frac >> (16 - PCC_POW2_STEP_SHIFT);
+	frac &= (1 << (16 - PCC_POW2_STEP_SHIFT)) - 1;
+	low = pcc_pow2_table[index];
+	high = pcc_pow2_table[index + 1];
+	pow = low + (((u64)(high - low) * frac) >> (16 - PCC_POW2_STEP_SHIFT));
+	return ((u64)pow << (x >> 16)) >> 30;
+}
+
+/* rate in PCC_RATE_UNIT bytes/sec to 1/2^PCC_VIVACE_SHIFT Mbps and back */
+static inline u64 pcc_vivace_mbps(u64 rate)
+{
+	return div_u64(pcc_rate_bytes(rate) * BITS_PER_BYTE << PCC_VIVACE_SHIFT,
+		       USEC_PER_SEC);
+}
+
+static inline u64 pcc_vivace_rate(u64 mbps)
+{
+	return div_u64(mbps * USEC_PER_SEC, BITS_PER_BYTE * PCC_RATE_UNIT) >>
+	       PCC_VIVACE_SHIFT;
+}
+
+/* x^0.9, x and the result in 1/2^PCC_VIVACE_SHIFT */
+static inline u64 pcc_vivace_pow(u64 x)
+{
+	u32 log;
+
+	if (!x)
+		return 0;
+	/* 2^(0.9 * (log2(x) - shift) + shift) */
+	log = (u64)pcc_log2(x) * pcc_vivace_exponent / 1000;
+	log += ((1000 - pcc_vivace_exponent) * PCC_VIVACE_SHIFT << 16) / 1000;
+	return pcc_pow2(log);
+}
+
+/* Vivace utility, in 1/2^PCC_VIVACE_SHIFT */
+static inline s64 pcc_vivace_utility(u32 rate, s32 gradient, u32 loss_ratio)
+{
+	s64 x = pcc_vivace_mbps(rate);
+	s64 util = pcc_vivace_pow(x);
+
+	util -= (x * pcc_vivace_latency_coef * gradient) >> PCC_GRADIENT_SHIFT;
+	util -= (x * pcc_vivace_loss_coef * loss_ratio / 100) >> PCC_LOSS_SHIFT;
+	return util;
+}
+
+/* Allegro utility, in PCC_RATE_UNIT bytes/sec */
+static inline s64 pcc_allegro_utility(const struct pcc_params *params,
+				      s64 rate, s64 goodput, u32 loss_ratio)
+{
+	s64 util;
+
+	/* util = goodput / (1 + e^(100*loss_rate)) - lost_ratio * rate
+	 * the sigmoid input is in 1/pcc_rounding_factor
+	 */
+	util = ((u64)loss_ratio * params->alpha * pcc_rounding_factor) >>
+	       PCC_LOSS_SHIFT;
+	util -= params->loss_margin * pcc_rounding_factor;
+	if (util < pcc_max_loss*pcc_rounding_factor)
+		util = (goodput * pcc_sigmoid(util)) >> PCC_SIGMOID_SHIFT;
+	else
+		util = 0;
+
+	/* util -= "wasted rate" */
+	util -= (rate * loss_ratio) >> PCC_LOSS_SHIFT;
+	return util;
+}
+
+/*************
+ * Decisions *
+ * ***********/
+/* PCC have 4 intervals, 2 for higher rate and 2 for lower rate */
+#define PCC_INTERVALS 4
+
+/* The intervals are a ring, indexed by counters of the intervals sent /
+ * received that wrap at twice its size, so a full ring is not empty */
+#define PCC_INDEX_MASK (2 * PCC_INTERVALS - 1)
+#define PCC_SLOT(index) ((index) % PCC_INTERVALS)
+
+static const u32 pcc_epsilon_part = 100;
+
+/* Epsilons are kept in 3 bits */
+#define PCC_EPSILON_BITS 3
+#define PCC_EPSILON_MAX ((1 << PCC_EPSILON_BITS) - 1)
+
+/* Decision making moves the rate once the votes of the last pairs all agree.
+ * It takes the votes of PCC_PAIRS_MIN pairs, and up to PCC_VOTES_MAX when the
+ * decisions keep turning back, see pcc_adapt_pairs() */
+#define PCC_PAIRS_MIN 2
+#define PCC_VOTES_MAX 4
+
+/* In decision making, keep sending intervals while the previous ones are still
+ * being acked, and decide on every pair received (against the pair before it)
+ * instead of waiting an RTT for every PCC_INTERVALS intervals */
+static const bool pcc_pipeline_intervals = true;
+
+/* PCC minimum rate is 1Kbps */
+static const u32 pcc_rate_minimum = 1024 >> PCC_RATE_SHIFT;
+
+/* Slow start moves to pcc_slow_start_gain times the goodput of its interval.
+ * Its decisions are about 2 RTTs apart (an interval and its acks), so this
+ * doubles the rate every RTT while the path keeps up */
+static const u32 pcc_slow_start_gain = 4;
+
+/* RTT gradients below 1% are noise */
+static const s32 pcc_vivace_gradient_noise = (1 << PCC_GRADIENT_SHIFT) / 100;
+
+/* Allegro can take a delay penalty (the "pcc_delay" sockets):
+ * util -= rate * 10% * (mean RTT - min RTT) / min RTT, where mean RTT is of the
+ * interval, and min RTT of the connection */
+static const u32 pcc_delay_penalty = 10;	/* in 1/100 */
+
+/* Vivace probes at rate +- 5% and moves by theta * m * gradient Mbps, m grows
+ * with every step in the same direction. A step is limited to a change
+ * boundary of 5% of the rate, which grows by 10% every time it was hit */
+static const u32 pcc_vivace_epsilon = 5;
+static const u32 pcc_vivace_theta = 1;
+static const u32 pcc_vivace_bound_base = 5;
+static const u32 pcc_vivace_bound_step = 10;
+#define PCC_VIVACE_AMPLIFIER_MAX 7
+#define PCC_VIVACE_BOUND_MAX 3
+
+enum PCC_DECISION {
+	PCC_RATE_UP,
+	PCC_RATE_DOWN,
+	PCC_RATE_STAY,
+};
+
+enum PCC_MODE {
+	PCC_SLOW_START, 
+	PCC_DECISION_MAKING,
+	PCC_RATE_ADJUSMENT,
+	PCC_LOSS, /* Not a mode of its own: tcp's Loss state, as reported */
+};
+
+/* What the decisions run on: the rate, the utility of the last interval
+ * received, the mode and the ring of intervals sent and received. The
+ * includer sends and receives the intervals, and calls the pcc_decide*() of
+ * the mode with their utilities */
+struct pcc_state {
+	u32 rate;		/* in PCC_RATE_UNIT bytes/sec */
+	u32 last_rate;
+	s32 utility;		/* last received, S32_MIN if nothing was counted */
+
+	u32	mode:2,
+		last_decision:2,
+		send_index:3,	   /* see PCC_INDEX_MASK */
+		recive_index:3,
+		wait_mode:1,
+		epsilon:3,
+		rate_high:PCC_INTERVALS, /* intervals sent at rate + epsilon */
+		rate_low:PCC_INTERVALS,	 /* intervals sent at rate - epsilon */
+		vivace:1,
+		amplifier:3,	   /* vivace steps in last_decision, minus one */
+		bound:2,	   /* vivace change boundary hits in a row */
+		delay:1,	   /* allegro with pcc_delay_penalty */
+		doubt:1,	   /* last interval was worse, see pcc_worse() */
+		split:1;	   /* last pair voted against the one before, or
+				    * its vivace gradient turned */
+	/* the epsilon each pair is sent with, see pcc_pair_epsilon(), and the
+	 * votes of the last pairs, newest first: did rate + epsilon win */
+	u32	pair_epsilon:PCC_INTERVALS / 2 * PCC_EPSILON_BITS,
+		votes:PCC_VOTES_MAX,
+		vote_count:3,	   /* votes held, up to PCC_VOTES_MAX */
+		pairs:3;	   /* votes that have to agree on a decision */
+};
+
+/* A new flow at rate: in slow start, or in decision making when the rate is
+ * known to fit the path already */
+static inline void pcc_init_state(struct pcc_state *s,
+				  const struct pcc_params *params, bool vivace,
+				  bool delay, u32 rate, enum PCC_MODE mode)
+{
+	s->vivace = vivace;
+	s->delay = delay;
+	s->epsilon = vivace ? pcc_vivace_epsilon : params->epsilon_min;
+	s->rate = rate;
+	s->last_rate = rate;
+	s->mode = mode;
+	s->utility = S32_MIN;
+	s->pairs = PCC_PAIRS_MIN;
+}
+
+/* Rates move within pcc_rate_minimum and max_rate */
+static inline u32 pcc_rate_bound(u64 rate, u32 max_rate)
+{
+	return max_t(u64, min_t(u64, rate, max_rate), pcc_rate_minimum);
+}
+
+static inline void pcc_change_mode(struct pcc_state *s, enum PCC_MODE mode)
+{
+	s->mode = mode;
+	s->doubt = false;
+}
+
+/* The epsilon each pair is sent with */
+static inline u32 pcc_pair_epsilon(const struct pcc_state *s, int pair)
+{
+	return (s->pair_epsilon >> (pair * PCC_EPSILON_BITS)) & PCC_EPSILON_MAX;
+}
+
+/* The rate an interval is sent at: intervals of decision making are sent at
+ * rate +- epsilon, all others at rate */
+static inline u32 pcc_interval_rate(const struct pcc_state *s, int slot)
+{
+	u32 epsilon = pcc_pair_epsilon(s, slot / 2);
+	u32 factor;
+
+	if (s->rate_high & (1 << slot))
+		factor = pcc_epsilon_part + epsilon;
+	else if (s->rate_low & (1 << slot))
+		factor = pcc_epsilon_part - epsilon;
+	else
+		return s->rate;
+
+	return div_u64((u64)s->rate * factor, pcc_epsilon_part);
+}
+
+/* Decision making intervals are sent in pairs, one at rate + epsilon and one
+ * at rate - epsilon in a random order (low_first, an unbiased bit). A pair is
+ * set up when it starts being sent, as epsilon may change while the previous
+ * pair is acked */
+static inline void pcc_setup_pair(struct pcc_state *s, int slot, bool low_first)
+{
+	int shift;
+
+	s->rate_high &= ~(3 << slot);
+	s->rate_low &= ~(3 << slot);
+
+	if (low_first) {
+		s->rate_low |= 1 << slot;
+		s->rate_high |= 1 << (slot + 1);
+	} else {
+		s->rate_high |= 1 << slot;
+		s->rate_low |= 1 << (slot + 1);
+	}
+	shift = slot / 2 * PCC_EPSILON_BITS;
+	s->pair_epsilon &= ~(PCC_EPSILON_MAX << shift);
+	s->pair_epsilon |= s->epsilon << shift;
+}
+
+/* Vivace moves the rate on every pair, so the pairs after it are not sent at
+ * the rate they were meant to. It waits for each pair before sending the
+ * next */
+static inline bool pcc_pipelined(const struct pcc_state *s)
+{
+	return pcc_pipeline_intervals && !s->vivace;
+}
+
+/* Without pipelining, every round of intervals starts from scratch */
+static inline u32 pcc_round_intervals(const struct pcc_state *s)
+{
+	return s->vivace ? 2 : PCC_INTERVALS;
+}
+
+/* A new round of intervals, sent from the first slot on */
+static inline void pcc_reset_intervals(struct pcc_state *s)
+{
+	s->rate_high = 0;
+	s->rate_low = 0;
+	s->send_index = 0;
+	s->recive_index = 0;
+	s->wait_mode = false;
+	s->votes = 0;
+	s->vote_count = 0;
+}
+
+/* The send interval ended. The next one is sent right away in decision making,
+ * unless the ring is full or the round was sent. Otherwise the flow waits for
+ * the intervals sent to be received, at its rate */
+static inline void pcc_next_send_interval(struct pcc_state *s)
+{
+	u32 pending;
+
+	s->send_index++;
+	pending = (s->send_index - s->recive_index) & PCC_INDEX_MASK;
+	/* a pair is set up for both its slots, so both have to be received */
+	if (!(s->send_index & 1))
+		pending++;
+
+	if (s->mode != PCC_DECISION_MAKING || pending >= PCC_INTERVALS ||
+	    (!pcc_pipelined(s) && !(s->send_index % pcc_round_intervals(s))))
+		s->wait_mode = true;
+}
+
+/* Decision making waits when all the intervals are still being acked. Sending
+ * starts again once they all were, as the end of the last one sent is not kept
+ * past the next one. Returns whether it does */
+static inline bool pcc_resume(struct pcc_state *s)
+{
+	if (s->wait_mode && s->recive_index == s->send_index) {
+		s->wait_mode = false;
+		return true;
+	}
+	return false;
+}
+
+/* rate * pcc_delay_penalty * queueing delay / min RTT */
+static inline s64 pcc_delay_utility(u32 rate, u32 mean_rtt, u32 min_rtt)
+{
+	u64 penalty;
+
+	if (mean_rtt <= min_rtt)
+		return 0;
+
+	penalty = (u64)rate * pcc_delay_penalty * (mean_rtt - min_rtt);
+	return div64_u64(penalty, (u64)min_rtt * 100);
+}
+
+/* The utility of an interval sent at rate: Vivace's in 1/2^PCC_VIVACE_SHIFT,
+ * Allegro's in PCC_RATE_UNIT bytes/sec, less the delay penalty of pcc_delay
+ * flows. gradient is of the interval's RTT, mean_rtt its mean and min_rtt the
+ * flow's, in usec */
+static inline s64 pcc_utility(const struct pcc_state *s,
+			      const struct pcc_params *params, u32 rate,
+			      u32 goodput, u32 loss_ratio, s32 gradient,
+			      u32 mean_rtt, u32 min_rtt)
+{
+	s64 util;
+
+	if (s->vivace)
+		return pcc_vivace_utility(rate, gradient, loss_ratio);
+
+	util = pcc_allegro_utility(params, rate, goodput, loss_ratio);
+	if (s->delay)
+		util -= pcc_delay_utility(rate, mean_rtt, min_rtt);
+	return util;
+}
+
+/* An RTT gradient as the utility takes it: within +-1, and 0 below
+ * pcc_vivace_gradient_noise */
+static inline s32 pcc_gradient(s64 gradient)
+{
+	if (abs(gradient) < pcc_vivace_gradient_noise)
+		return 0;
+	return clamp_t(s64, gradient, -(1 << PCC_GRADIENT_SHIFT),
+		       1 << PCC_GRADIENT_SHIFT);
+}
+
+static inline void pcc_increase_epsilon(struct pcc_state *s,
+					const struct pcc_params *params)
+{
+	if (s->epsilon < params->epsilon_max)
+		s->epsilon++;
+}
+
+static inline enum PCC_DECISION
+pcc_get_decision(const struct pcc_state *s, u32 new_rate)
+{
+	if (s->rate == new_rate)
+		return PCC_RATE_STAY;
+
+	return s->rate < new_rate ? PCC_RATE_UP : PCC_RATE_DOWN;
+}
+
+static inline void
+pcc_change_epsilon_after_dicision(struct pcc_state *s,
+				  const struct pcc_params *params, u32 new_rate)
+{
+	enum PCC_DECISION decision = pcc_get_decision(s, new_rate);
+
+	if (decision == s->last_decision)
+		pcc_increase_epsilon(s, params);
+	else
+		s->epsilon = params->epsilon_min;
+
+	s->last_decision = decision;
+}
+
+/* Did the interval sent at rate + epsilon have the better utility. first is the
+ * utility of the first interval of the pair, s->utility of the second */
+static inline bool pcc_pair_vote(const struct pcc_state *s, int pair,
+				 s32 first)
+{
+	bool run_res = first > s->utility;
+
+	return run_res == !!(s->rate_high & (1 << pair));
+}
+
+static inline void pcc_add_vote(struct pcc_state *s, bool vote)
+{
+	s->split = s->vote_count && vote != (s->votes & 1);
+	s->votes = (s->votes << 1 | vote) & ((1 << PCC_VOTES_MAX) - 1);
+	if (s->vote_count < PCC_VOTES_MAX)
+		s->vote_count++;
+}
+
+/* Once the votes of the last s->pairs pairs agree, the rate moves to the one
+ * they voted for (of the pair that ended last), and to rate adjustment */
+static inline u32 pcc_decide_rate(struct pcc_state *s, int pair)
+{
+	u32 mask = (1 << s->pairs) - 1;
+	u32 votes = s->votes & mask;
+	bool vote = votes;
+
+	if (votes && votes != mask)
+		return s->rate;
+
+	pcc_change_mode(s, PCC_RATE_ADJUSMENT);
+	return vote == !!(s->rate_high & (1 << pair)) ?
+	       pcc_interval_rate(s, pair) :
+	       pcc_interval_rate(s, pair + 1);
+}
+
+/* Deciding the same way as the decision before says the votes are clean, and
+ * fewer pairs will do. Turning back, or pairs that didn't agree in between, say
+ * they are noisy, and at the optimum rate it stops the rate from oscillating */
+static inline void pcc_adapt_pairs(struct pcc_state *s,
+				   enum PCC_DECISION decision)
+{
+	if (decision == s->last_decision) {
+		if (s->pairs > PCC_PAIRS_MIN)
+			s->pairs--;
+	} else if (s->pairs < PCC_VOTES_MAX) {
+		s->pairs++;
+	}
+}
+
+/* Called when a pair of intervals, ending at slot, was received. Its result is
+ * added to the votes of the pairs received before it. Returns the decision, or
+ * -1 when there was none: the pair couldn't vote, or the votes are too few.
+ * When the votes don't agree the rate stays, and so does decision making.
+ * Rates move within pcc_rate_bound() */
+static inline int pcc_decide(struct pcc_state *s,
+			     const struct pcc_params *params, int slot,
+			     s32 first, u32 max_rate)
+{
+	enum PCC_DECISION decision;
+	u32 new_rate;
+	u64 extra_rate;
+
+	s->split = false;
+	/* the pair can't vote, the votes so far stay for the next one */
+	if (first == S32_MIN || s->utility == S32_MIN)
+		return -1;
+
+	pcc_add_vote(s, pcc_pair_vote(s, slot - 1, first));
+	if (s->vote_count < s->pairs)
+		return -1;
+
+	new_rate = pcc_rate_bound(pcc_decide_rate(s, slot - 1), max_rate);
+	decision = pcc_get_decision(s, new_rate);
+	if (s->mode == PCC_RATE_ADJUSMENT)
+		pcc_adapt_pairs(s, decision);
+	pcc_change_epsilon_after_dicision(s, params, new_rate);
+
+	if (s->mode == PCC_RATE_ADJUSMENT) {
+		s->last_rate = new_rate;
+		s->rate = new_rate;
+		extra_rate = (u64)new_rate * s->epsilon;
+		extra_rate = div_u64(extra_rate, pcc_epsilon_part);
+		if (s->last_decision == PCC_RATE_DOWN)
+			s->rate = pcc_rate_bound(s->rate - extra_rate,
+						 max_rate);
+		else
+			s->rate = pcc_rate_bound(s->rate + extra_rate,
+						 max_rate);
+	}
+	return decision;
+}
+
+/* Vivace: move the rate along the utility gradient of the pair ending at
+ * slot. first is the utility of the first interval of the pair, s->utility
+ * of the second. Returns the decision and its step (in *step), or -1 when
+ * there was none */
+static inline int pcc_vivace_decide(struct pcc_state *s, int slot, s32 first,
+				    u32 max_rate, s64 *step)
+{
+	int high = slot - 1, low = slot;
+	s32 u_high = first, u_low = s->utility;
+	s64 x_high, x_low, bound;
+	enum PCC_DECISION decision;
+
+	s->split = false;
+	if (!(s->rate_high & (1 << high))) {
+		swap(high, low);
+		swap(u_high, u_low);
+	}
+	if (u_high == S32_MIN || u_low == S32_MIN)
+		return -1;
+
+	x_high = pcc_vivace_mbps(pcc_interval_rate(s, high));
+	x_low = pcc_vivace_mbps(pcc_interval_rate(s, low));
+	if (x_high == x_low)
+		return -1;
+
+	/* step = theta * m * (u_high - u_low) / (x_high - x_low) */
+	*step = (s64)u_high - u_low;
+	*step = div64_s64(*step << PCC_VIVACE_SHIFT, x_high - x_low);
+	decision = *step > 0 ? PCC_RATE_UP : PCC_RATE_DOWN;
+
+	if (decision == s->last_decision) {
+		if (s->amplifier < PCC_VIVACE_AMPLIFIER_MAX)
+			s->amplifier++;
+	} else {
+		/* the gradient turned against the pair before */
+		s->split = true;
+		s->amplifier = 0;
+		s->bound = 0;
+	}
+	s->last_decision = decision;
+	*step *= pcc_vivace_theta * (s->amplifier + 1);
+
+	bound = pcc_vivace_mbps(s->rate) *
+		(pcc_vivace_bound_base + s->bound * pcc_vivace_bound_step);
+	bound = div_u64(bound, 100);
+	if (abs(*step) > bound) {
+		*step = *step > 0 ? bound : -bound;
+		if (s->bound < PCC_VIVACE_BOUND_MAX)
+			s->bound++;
+	} else {
+		s->bound = 0;
+	}
+
+	if (*step > 0)
+		s->rate = pcc_rate_bound((u64)s->rate + pcc_vivace_rate(*step),
+					 max_rate);
+	else
+		s->rate = pcc_rate_bound(max_t(s64, (s64)s->rate -
+					       pcc_vivace_rate(-*step), 0),
+					 max_rate);
+	return decision;
+}
+
+/* Random loss moves the utility of an interval: k of its n segs lost take about
+ * k/n of it, and the count of random losses deviates by sqrt(k). Changes within
+ * pcc_utility_confidence deviations of that, or of a seg (the interval ends
+ * between two), say nothing of the rate. Under loss, or on short intervals,
+ * that would be wider than what the step (in %) between the two rates compared
+ * moves the utility by, and hide it, so it is capped at that */
+static inline s64 pcc_utility_noise(s64 utility, u32 lost, u32 segs, u32 step)
+{
+	u64 margin = (u64)abs(utility) * pcc_utility_confidence;
+	u64 cap = div_u64((u64)abs(utility) * step, pcc_epsilon_part);
+
+	if (!segs)
+		return 0;
+	margin = div_u64(margin * int_sqrt(lost) + abs(utility), segs);
+	return min(margin, cap);
+}
+
+/* Returns -1 the first time, to measure again, and 1 once it is confirmed */
+static inline int pcc_doubt(struct pcc_state *s)
+{
+	if (!s->doubt) {
+		s->doubt = true;
+		return -1;
+	}
+	s->doubt = false;
+	return 1;
+}
+
+/* A single interval below the margin (its pcc_utility_noise(), from the lost
+ * of its segs and the step from the rate of prev) can still be a burst, so it
+ * only counts once the next one confirms it. Until then the same rate is
+ * measured again against the same utility.
+ * Returns 1 when utility is worse than prev, 0 when it is not, and -1 when it
+ * has to be measured again (s->doubt is then set) */
+static inline int pcc_worse(struct pcc_state *s, s64 utility, s64 prev,
+			    u32 lost, u32 segs, u32 step)
+{
+	if (utility >= prev - pcc_utility_noise(utility, lost, segs, step)) {
+		s->doubt = false;
+		return 0;
+	}
+	return pcc_doubt(s);
+}
+
+/* Rate adjustment keeps moving the rate the way decision making decided, by a
+ * growing epsilon, while the utility is not worse than the one before. Called
+ * with s->utility of the interval received and prev of the one before, lost
+ * and segs are of the interval. Returns false when nothing was measured, the
+ * same rate is then tried again */
+static inline bool pcc_decide_rate_adjusment(struct pcc_state *s,
+					     const struct pcc_params *params,
+					     s32 prev, u32 lost, u32 segs,
+					     u32 max_rate)
+{
+	u64 extra_rate;
+	int worse;
+
+	if (s->utility == S32_MIN) {
+		s->utility = prev;
+		return false;
+	}
+
+	worse = pcc_worse(s, s->utility, prev, lost, segs, s->epsilon);
+	if (worse < 0) {
+		s->utility = prev;
+	} else if (!worse) {
+		pcc_increase_epsilon(s, params);
+		extra_rate = div_u64((u64)s->rate * s->epsilon,
+				     pcc_epsilon_part);
+		s->last_rate = s->rate;
+		if (s->last_decision == PCC_RATE_UP)
+			s->rate = pcc_rate_bound(s->rate + extra_rate,
+						 max_rate);
+		else
+			s->rate = pcc_rate_bound(s->rate - extra_rate,
+						 max_rate);
+	} else {
+		s->rate = s->last_rate;
+		s->epsilon = params->epsilon_min;
+		pcc_change_mode(s, PCC_DECISION_MAKING);
+	}
+	return true;
+}
+
+/* Utility per rate, in 1/1024 */
+static inline s64 pcc_adjust_utility(s32 utility, u32 rate)
+{
+	if (utility == S32_MIN)
+		return S64_MIN;
+
+	return (s64)utility * 1024 / rate;
+}
+
+/* The step (in %) between the rates of the last two intervals, at least
+ * epsilon */
+static inline u32 pcc_rate_step(const struct pcc_state *s)
+{
+	u32 low = min_t(u32, s->rate, s->last_rate);
+	u32 high = max_t(u32, s->rate, s->last_rate);
+	u64 step;
+
+	if (!low)
+		return s->epsilon;
+	step = div_u64((u64)(high - low) * pcc_epsilon_part, low);
+
+	return min_t(u64, max_t(u64, step, s->epsilon), U32_MAX);
+}
+
+/* Slow start moves to pcc_slow_start_gain times the goodput of the interval
+ * received (in PCC_RATE_UNIT bytes/sec), while its utility per rate is not
+ * worse than the one before and its loss within params->loss_margin. Called as
+ * pcc_decide_rate_adjusment() */
+static inline bool pcc_decide_slow_start(struct pcc_state *s,
+					 const struct pcc_params *params,
+					 s32 prev, u32 goodput, u32 lost,
+					 u32 segs, u32 max_rate)
+{
+	s64 adjust_utility, prev_adjust_utility;
+	bool full;
+	u64 rate;
+	int worse;
+
+	prev_adjust_utility = pcc_adjust_utility(prev, s->last_rate);
+	if (s->utility == S32_MIN) {
+		s->utility = prev;
+		return false;
+	}
+	adjust_utility = pcc_adjust_utility(s->utility, s->rate);
+
+	/* loss over the margin, or a goodput that doesn't follow the rate,
+	 * say the rate is past the path whatever the utility (a rate above the
+	 * path from the start has nothing better to compare to), and it backs
+	 * off toward the goodput. The first interval has nothing to compare
+	 * to */
+	full = (u64)lost * 100 > (u64)params->loss_margin * segs ||
+	       (u64)goodput * pcc_slow_start_gain <= s->rate;
+	if (full)
+		worse = pcc_doubt(s);
+	else if (prev == S32_MIN)
+		worse = 0;
+	else
+		worse = pcc_worse(s, adjust_utility, prev_adjust_utility, lost,
+				  segs, pcc_rate_step(s));
+	if (worse < 0) {
+		s->utility = prev;
+	} else if (!worse) {
+		s->last_rate = s->rate;
+		rate = (u64)goodput * pcc_slow_start_gain;
+		s->rate = pcc_rate_bound(rate, max_rate);
+	} else if (full) {
+		/* slow start only left last_rate for this one while it wasn't
+		 * full */
+		rate = s->last_rate < s->rate ? max_t(u32, goodput, s->last_rate) :
+		       goodput;
+		s->last_rate = s->rate;
+		s->rate = pcc_rate_bound(rate, max_rate);
+		pcc_change_mode(s, PCC_DECISION_MAKING);
+	} else {
+		s->rate = s->last_rate;
+		pcc_change_mode(s, PCC_DECISION_MAKING);
+	}
+	return true;
+}
+
+#endif /* _PCC_CORE_H */
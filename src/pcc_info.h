@@ -0,0 +1,36 @@
+/* PCC per socket state, as reported to inet_diag (ss -ti, netlink
+ * SOCK_DIAG_BY_FAMILY dumps) by the get_info hook.
+ * There is no PCC attribute in the kernel headers, so the struct comes in a
+ * private INET_DIAG_PCCINFO attribute that stock ss skips. It is requested by
+ * INET_DIAG_INFO, and shared with userspace tools, so only fixed size types
+ * and new fields at the end.
+ */
+#ifndef _PCC_INFO_H
+#define _PCC_INFO_H
+
+#include <linux/types.h>
+
+#define INET_DIAG_PCCINFO 0x100
+
+/* pcc_flags */
+#define PCC_INFO_VIVACE	0x1
+#define PCC_INFO_DELAY	0x2
+
+/* Must fit in union tcp_cc_info */
+/* Rates and Allegro utilities are in bytes/sec. The union leaves no room for
+ * 64 bits, so they saturate: rates at UINT32_MAX (34 Gbit/s), utilities at
+ * INT32_MAX (17 Gbit/s). tcpi_pacing_rate of tcp_info has the rate in full */
+struct tcp_pcc_info {
+	__u32	pcc_rate;		/* in bytes/sec */
+	__u32	pcc_last_rate;
+	/* of the last interval received, 0x80000000 if nothing was counted.
+	 * Allegro in bytes/sec, Vivace in 1/1024 Mbps */
+	__s32	pcc_utility;
+	__s32	pcc_intervals_count;
+	__u8	pcc_mode;		/* slow start, decision, adjust, loss */
+	__u8	pcc_epsilon;		/* in 1% */
+	__u8	pcc_flags;
+	__u8	pcc_pad;
+};
+
+#endif /* _PCC_INFO_H */
@@ -0,0 +1,171 @@
+/* PCC tracepoints:
+ * Binary records of interval results, decisions and mode changes. They go to
+ * the per-cpu ftrace ring buffers, so nothing is locked in the ACK path and
+ * nothing is recorded unless the events are enabled:
+ * 	echo 1 > /sys/kernel/tracing/events/tcp_pcc/enable
+ * 	cat /sys/kernel/tracing/trace_pipe
+ * Build with CONFIG_TCP_PCC_TRACE=n to compile them out completely.
+ */
+#ifndef CONFIG_TCP_PCC_TRACE
+
+#ifndef _PCC_TRACE_H
+#define _PCC_TRACE_H
+
+static inline void trace_pcc_interval(const struct sock *sk, u64 rate,
+				      u64 goodput, u32 delivered, u32 lost,
+				      s64 utility, u32 rtt_min, u32 rtt_mean,
+				      s32 rtt_gradient)
+{
+}
+
+static inline void trace_pcc_decision(const struct sock *sk, int mode,
+				      u64 rate, u64 new_rate, s64 utility,
+				      u32 epsilon, int intervals_count,
+				      u32 rtt)
+{
+}
+
+static inline void trace_pcc_mode(const struct sock *sk, int old_mode,
+				  int new_mode)
+{
+}
+
+#endif /* _PCC_TRACE_H */
+
+#else /* CONFIG_TCP_PCC_TRACE */
+
+#undef TRACE_SYSTEM
+#ifdef PCC_VERSION
+#define TRACE_SYSTEM __PASTE(tcp_pcc, PCC_VERSION)
+#else
+#define TRACE_SYSTEM tcp_pcc
+#endif
+
+#if !defined(_PCC_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _PCC_TRACE_H
+
+#include <linux/tracepoint.h>
+
+TRACE_DEFINE_ENUM(PCC_SLOW_START);
+TRACE_DEFINE_ENUM(PCC_DECISION_MAKING);
+TRACE_DEFINE_ENUM(PCC_RATE_ADJUSMENT);
+TRACE_DEFINE_ENUM(PCC_LOSS);
+
+#define show_pcc_mode(mode)					\
+	__print_symbolic(mode,					\
+			 { PCC_SLOW_START, "slow_start" },	\
+			 { PCC_DECISION_MAKING, "decision" },	\
+			 { PCC_RATE_ADJUSMENT, "adjust" },	\
+			 { PCC_LOSS, "loss" })
+
+/* One record per interval whose utility was calculated. The RTT gradient is
+ * in 1/65536 usec per usec */
+TRACE_EVENT(pcc_interval,
+
+	TP_PROTO(const struct sock *sk, u64 rate, u64 goodput, u32 delivered,
+		 u32 lost, s64 utility, u32 rtt_min, u32 rtt_mean,
+		 s32 rtt_gradient),
+
+	TP_ARGS(sk, rate, goodput, delivered, lost, utility, rtt_min, rtt_mean,
+		rtt_gradient),
+
+	TP_STRUCT__entry(
+		__field(const void *, skaddr)
+		__field(u64, rate)
+		__field(u64, goodput)
+		__field(s64, utility)
+		__field(u32, delivered)
+		__field(u32, lost)
+		__field(u32, rtt_min)
+		__field(u32, rtt_mean)
+		__field(s32, rtt_gradient)
+	),
+
+	TP_fast_assign(
+		__entry->skaddr = sk;
+		__entry->rate = rate;
+		__entry->goodput = goodput;
+		__entry->utility = utility;
+		__entry->delivered = delivered;
+		__entry->lost = lost;
+		__entry->rtt_min = rtt_min;
+		__entry->rtt_mean = rtt_mean;
+		__entry->rtt_gradient = rtt_gradient;
+	),
+
+	TP_printk("sk=%p rate=%llu goodput=%llu delivered=%u lost=%u utility=%lld rtt_min=%u rtt_mean=%u rtt_gradient=%d",
+		  __entry->skaddr, __entry->rate, __entry->goodput,
+		  __entry->delivered, __entry->lost, __entry->utility,
+		  __entry->rtt_min, __entry->rtt_mean, __entry->rtt_gradient)
+);
+
+/* One record per decision: the rate the decision was made on and the rate
+ * that will be used from now on */
+TRACE_EVENT(pcc_decision,
+
+	TP_PROTO(const struct sock *sk, int mode, u64 rate, u64 new_rate,
+		 s64 utility, u32 epsilon, int intervals_count, u32 rtt),
+
+	TP_ARGS(sk, mode, rate, new_rate, utility, epsilon, intervals_count,
+		rtt),
+
+	TP_STRUCT__entry(
+		__field(const void *, skaddr)
+		__field(u64, rate)
+		__field(u64, new_rate)
+		__field(s64, utility)
+		__field(u32, epsilon)
+		__field(int, intervals_count)
+		__field(u32, rtt)
+		__field(u8, mode)
+	),
+
+	TP_fast_assign(
+		__entry->skaddr = sk;
+		__entry->rate = rate;
+		__entry->new_rate = new_rate;
+		__entry->utility = utility;
+		__entry->epsilon = epsilon;
+		__entry->intervals_count = intervals_count;
+		__entry->rtt = rtt;
+		__entry->mode = mode;
+	),
+
+	TP_printk("sk=%p mode=%s rate=%llu new_rate=%llu utility=%lld epsilon=%u intervals=%d rtt=%u",
+		  __entry->skaddr, show_pcc_mode(__entry->mode),
+		  __entry->rate, __entry->new_rate, __entry->utility,
+		  __entry->epsilon, __entry->intervals_count, __entry->rtt)
+);
+
+TRACE_EVENT(pcc_mode,
+
+	TP_PROTO(const struct sock *sk, int old_mode, int new_mode),
+
+	TP_ARGS(sk, old_mode, new_mode),
+
+	TP_STRUCT__entry(
+		__field(const void *, skaddr)
+		__field(u8, old_mode)
+		__field(u8, new_mode)
+	),
+
+	TP_fast_assign(
+		__entry->skaddr = sk;
+		__entry->old_mode = old_mode;
+		__entry->new_mode = new_mode;
+	),
+
+	TP_printk("sk=%p %s -> %s",
+		  __entry->skaddr, show_pcc_mode(__entry->old_mode),
+		  show_pcc_mode(__entry->new_mode))
+);
+
+#endif /* _PCC_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE pcc_trace
+#include <trace/define_trace.h>
+
+#endif /* CONFIG_TCP_PCC_TRACE */
@@ -1,107 +1,393 @@
 /* PCC alegro:
  * This is draft of PCC v1, also known as PCC alegro.
+ * PCC Vivace (utility with a latency term, gradient rate steps) reuses its
+ * intervals and is registered as "pcc_vivace".
  * Main issues are:
- * 	Lack of order (not everything is documented, lots of debug print, some
- * 	magic numbers, etc.)
- * 	Doesn't work too well when the delay is low and the rate is high.
+ * 	Lack of order (not everything is documented, some magic numbers, etc.)
  */ 
 
 #include <linux/module.h>
 #include <net/tcp.h>
 #include <linux/random.h>
+#include <linux/percpu.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/hash.h>
+#include <linux/jump_label.h>
+#include <linux/sched/clock.h>
+#include <linux/log2.h>
+#include <net/ipv6.h>
+#include <net/netns/hash.h>
+
+#include "pcc_compat.h"
+#include "pcc_core.h"
+
+/* The module parameters as last set, see pcc_param_set(). Flows don't read them
+ * here, but through pcc_params_get() */
+static struct pcc_params pcc_params = {
+	.ignore_packets = 5,
+	.interval_min_segs = 40,
+	.epsilon_min = 1,
+	.epsilon_max = 5,
+	.loss_margin = 5,
+	.alpha = 100,
+	.initial_rate = 512 * 1024,
+	.dst_cache_timeout = 0,
+	.path_share = 0,
+};
+
+static const u32 pcc_dst_cache_timeout_max = 24 * 3600;
+static const u32 pcc_initial_rate_max = 125000000;	/* 1 Gbit/s */
+
+/* pcc_params as a whole, published with RCU so a reader never sees part of an
+ * update. Flows take them once for every interval they start and decision
+ * they take, so the values they use with each other (the ignored parts within
+ * an interval, the epsilon range) always agree */
+struct pcc_params_rcu {
+	struct pcc_params params;
+	struct rcu_head rcu;
+};
+
+static struct pcc_params_rcu __rcu *pcc_params_live;
+
+/* Under rcu_read_lock(), which the hooks that read them take */
+static const struct pcc_params *pcc_params_get(void)
+{
+	return &rcu_dereference(pcc_params_live)->params;
+}
+
+/* With a high rate and low delay, interval_min_segs go by in a few usecs and
+ * the stats are noise. So both the interval length and its ignored parts are
+ * scaled up to send for at least pcc_interval_rtts RTTs */
+static const u32 pcc_interval_rtts = 1;
+
+#define PCC_RTT_SAMPLES_MAX ((1 << 15) - 1)
+
+/* The interpolated table is within 12.2/2^PCC_SIGMOID_SHIFT of the real
+ * sigmoid. The load time self-test checks it to 1/2^PCC_SIGMOID_TEST_SHIFT of
+ * that */
+#define PCC_SIGMOID_TEST_SHIFT 4
+#define PCC_SIGMOID_MAX_ERROR 195	/* 12.2 << PCC_SIGMOID_TEST_SHIFT */
+
+/* cwnd = rate * rtt / mss plus headroom, see pcc_set_cwnd(). "rate / mss" -
+ * the segments per usec of RTT - is kept in 1/2^PCC_CWND_GAIN_SHIFT and only
+ * recalculated when the rate changes, so there is no division left for the ack
+ * path */
+#define PCC_CWND_GAIN_SHIFT 24
+
+/* The RTT cwnd was set for, with its headroom (see pcc_cwnd_rtt()), is kept in
+ * PCC_CWND_RTT_BITS (8 seconds), longer ones are capped */
+#define PCC_CWND_RTT_BITS 23
+#define PCC_CWND_RTT_MAX ((1U << PCC_CWND_RTT_BITS) - 1)
+
+/* cwnd headroom for ACK aggregation is kept in 1/2^PCC_CWND_EXTRA_SHIFT of the
+ * BDP, up to PCC_CWND_EXTRA_MAX (the BDP). It drops by 1/2^pcc_cwnd_extra_decay
+ * with every received interval, so a burst is covered for a few RTTs */
+#define PCC_CWND_EXTRA_SHIFT 6
+#define PCC_CWND_EXTRA_MAX (1U << PCC_CWND_EXTRA_SHIFT)
+static const u32 pcc_cwnd_extra_decay = 3;
+
+/* On acks, cwnd is only recalculated when pcc_cwnd_rtt() moved by more than
+ * 1/2^pcc_cwnd_rtt_band (or the mss changed) since it was last set */
+static const u32 pcc_cwnd_rtt_band = 3;
+
+/* TSO bursts, see pcc_tso_segs(). The stack's own are of 2^-10 sec of the
+ * pacing rate, about the same */
+static const u32 pcc_tso_burst_us = 1000;
+static const u32 pcc_tso_single_rate = 150000;	/* bytes/sec, 1.2 Mbps */
+
+#define CREATE_TRACE_POINTS
+#include "pcc_trace.h"
+#include "pcc_info.h"
+
+/* One "experiment" interval.
+ * Intervals are marked by tp->delivered when they started being sent. The
+ * delivery rate sampling records it for every packet sent, so an ack is of the
+ * interval its rs->prior_delivered falls in. The counter wraps, so it is only
+ * compared with before() / after().
+ * An interval ends where the next one starts, so only the end of the last
+ * interval sent is kept (pcc_data.delivered_end). Its rate is not stored
+ * either, see pcc_interval_rate(). Intervals are received one at a time, so
+ * the statistics are only kept for the one being received and its utility
+ * until the next one is calculated (pcc_state.utility). */
+struct pcc_interval {
+	u32 delivered_start;
+};
+
+/* Lives inline in icsk_ca_priv, keep it within ICSK_CA_PRIV_SIZE */
+struct pcc_data {
+	struct pcc_interval intervals[PCC_INTERVALS];
+
+	/* RTT samples of the receive interval, see pcc_rtt_sample(). The index
+	 * sum is below 2^47: rtt_sum is a u32 over less than 2^15 samples */
+	u64 rtt_index_sum:47,	/* of sample index * RTT */
+	    rtt_samples:15,	/* summed up in rtt_sum */
+	    app_limited:1,	/* receive interval had app limited samples */
+	    counting:1;		/* past the ignored part */
+	u32 rtt_min;
+	u32 rtt_sum;		/* in usec */
+
+	u32 delivered_end;
+	u32 send_end_mstamp;	/* usec, when the send interval ends */
+
+	/* lost / delivered counters and time (usec, lower 32 bits of
+	 * tcp_mstamp), when the receive interval started being counted */
+	u32 lost_base;
+	u32 delivered_base;
+	u32 counting_mstamp;
+
+	u32 cwnd_gain;		/* in 1/2^PCC_CWND_GAIN_SHIFT segs per usec */
+	/* RTT and mss cwnd was last calculated for, and its ACK aggregation
+	 * headroom */
+	u32 cwnd_rtt:PCC_CWND_RTT_BITS,
+	    cwnd_extra:PCC_CWND_EXTRA_SHIFT + 1,
+	    shared:1,		/* joined its path, see pcc_path_join() */
+	    inited:1;		/* see pcc_valid() */
+	u16 cwnd_mss;
+	u16 interval_scale;	/* of interval_min_segs / ignore_packets */
+
+	struct pcc_state state;	/* the decisions, see pcc_core.h */
+
+#ifdef CONFIG_TCP_PCC_DEBUG
+	int intervals_count;	/* see pcc_intervals_count() */
+#endif
+};
 
-/* Ignore the first and last packets of every interval because they might
- * contain data of the previous / next interval. */
-static const u32 pcc_ignore_packets = 5;
+/**************
+ * Statistics *
+ * ************/
+/* Module wide counters, per cpu so the ack path bumps them without locking.
+ * They are summed up on read from debugfs tcp_pcc/stats */
+enum pcc_stat {
+	PCC_STAT_CWND_UPDATES,
+	PCC_STAT_CWND_SKIPPED,
+	/* decision making, as PCC_RATE_UP + enum PCC_DECISION */
+	PCC_STAT_DECISIONS_UP,
+	PCC_STAT_DECISIONS_DOWN,
+	PCC_STAT_DECISIONS_STAY,
+	PCC_STAT_DISAGREEMENTS,	/* pairs that voted against the one before */
+	PCC_STAT_DOUBTS,	/* worse utilities measured again, pcc_worse() */
+	PCC_STAT_LOSS_EPISODES,
+	PCC_STAT_RETRANS_DELIVERED, /* acks not added to interval deliveries */
+	PCC_STAT_SAMPLES,
+	PCC_STAT_FAST_SAMPLES,	/* of them, crossed no boundary */
+	PCC_STATS
+};
 
-/* Interval should have a minimal number of segs, otherwise, it is not possible
- * to calculate stats about it. This length include two ignore part, one in the
- * beginning and one in the end. It limits the interval data to at least 20 segs,
- * which gives the ability to notice 5% loss */
-static const u32 pcc_interval_min_segs = 40;
+static const char * const pcc_stat_names[PCC_STATS] = {
+	[PCC_STAT_CWND_UPDATES] = "cwnd_updates",
+	[PCC_STAT_CWND_SKIPPED] = "cwnd_skipped",
+	[PCC_STAT_DECISIONS_UP] = "decisions_up",
+	[PCC_STAT_DECISIONS_DOWN] = "decisions_down",
+	[PCC_STAT_DECISIONS_STAY] = "decisions_stay",
+	[PCC_STAT_DISAGREEMENTS] = "disagreements",
+	[PCC_STAT_DOUBTS] = "doubts",
+	[PCC_STAT_LOSS_EPISODES] = "loss_episodes",
+	[PCC_STAT_RETRANS_DELIVERED] = "retrans_delivered",
+	[PCC_STAT_SAMPLES] = "samples",
+	[PCC_STAT_FAST_SAMPLES] = "fast_samples",
+};
+
+struct pcc_stats {
+	u64 count[PCC_STATS];
+};
 
-/* Epsilon is between 1% to 5%, and in granularity of 1% */
-static const u32 pcc_epsilon_max = 5;
-static const u32 pcc_epsilon_min = 1;
-static const u32 pcc_epsilon_part = 100;
+static DEFINE_PER_CPU(struct pcc_stats, pcc_stats);
+static struct dentry *pcc_debugfs_dir;
 
-/* PCC have 4 intervals, 2 for higher rate and 2 for lower rate */
-static const u32 pcc_intervals = 4;
+#define pcc_stats_inc(stat) this_cpu_inc(pcc_stats.count[stat])
 
-/* PCC minimum rate is 1Kbps */
-static const u64 pcc_rate_minimum = 1024;
+static int pcc_stats_show(struct seq_file *seq, void *v)
+{
+	struct pcc_stats sum = {};
+	int cpu, i;
 
-/* PCC allows for 5% loss before drastic utility decreasment */
-static const u32 pcc_loss_margin = 5;
-/* PCC utility function const: alpha parameter for the sigmoid function */
-static const u32 pcc_alpha = 100;
+	for_each_possible_cpu(cpu) {
+		const struct pcc_stats *stats = per_cpu_ptr(&pcc_stats, cpu);
 
-/* PCC utility function rounding factor. The utility function is rounded up to 
- * 1/pcc_rounding_factor */
-static const u32 pcc_rounding_factor = 1000;
+		for (i = 0; i < PCC_STATS; i++)
+			sum.count[i] += stats->count[i];
+	}
 
-/* Limit the input sent to calculate sigmoid on, to avoid long calculation that
- * will result in zero */
-static const u32 pcc_max_loss = 10;
+	for (i = 0; i < PCC_STATS; i++)
+		seq_printf(seq, "%s %llu\n", pcc_stat_names[i], sum.count[i]);
+	return 0;
+}
 
-static const s32 pcc_slow_start_threshold = 750;
-static const s32 pcc_slow_start_threshold_base = 1000;
+static int pcc_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, pcc_stats_show, NULL);
+}
 
-enum PCC_DECISION {
-	PCC_RATE_UP,
-	PCC_RATE_DOWN,
-	PCC_RATE_STAY,
+static const struct file_operations pcc_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = pcc_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
 };
 
-enum PCC_MODE {
-	PCC_SLOW_START, 
-	PCC_DECISION_MAKING,
-	PCC_RATE_ADJUSMENT,
-	PCC_LOSS, /* When tcp is in loss state, its stats can't be trusted */
+/**********
+ * Timing *
+ * ********/
+/* Per cpu log2 histograms of the time the ack path and the decisions take, in
+ * debugfs tcp_pcc/times. Off by default: the timed sites are static branches,
+ * patched in by writing 1 to the file (0 patches them out again) */
+enum pcc_time {
+	PCC_TIME_SAMPLE,	/* all of pcc_process_sample() */
+	PCC_TIME_DECIDE,	/* a decision making interval, with its utility */
+	PCC_TIME_SLOW_START,
+	PCC_TIME_RATE_ADJUST,
+	PCC_TIMES
 };
 
-/* Contains the statistics from one "experiment" interval */
-struct pcc_interval {
-	u64 rate;
+static const char * const pcc_time_names[PCC_TIMES] = {
+	[PCC_TIME_SAMPLE] = "sample",
+	[PCC_TIME_DECIDE] = "decide",
+	[PCC_TIME_SLOW_START] = "slow_start",
+	[PCC_TIME_RATE_ADJUST] = "rate_adjust",
+};
 
-	u32 segs_sent_start;
-	u32 segs_sent_end;
+/* Bucket i counts times of [2^(i-1), 2^i) nsec, the last one everything
+ * longer */
+#define PCC_TIME_BUCKETS 24
 
-	s64 utility;
-	u32 lost;
-	u32 delivered;
+struct pcc_times {
+	u64 hist[PCC_TIMES][PCC_TIME_BUCKETS];
 };
 
-static int id = 0;
-struct pcc_data {
-	struct pcc_interval *intervals;
-	struct pcc_interval *single_interval;
-	int send_index;
-	int recive_index;
-
-	enum PCC_MODE mode;
-	u64 rate;
-	u64 last_rate;
-	u32 epsilon;
-	bool wait_mode;
-
-	enum PCC_DECISION last_decision;
-	u32 lost_base;
-	u32 delivered_base;
+static DEFINE_PER_CPU(struct pcc_times, pcc_times);
+static DEFINE_STATIC_KEY_FALSE(pcc_timing);
+
+/* 0 when timing is off */
+static u64 pcc_time_start(void)
+{
+	if (static_branch_unlikely(&pcc_timing))
+		return local_clock();
+	return 0;
+}
+
+static void pcc_time_end(enum pcc_time time, u64 start)
+{
+	u64 ns;
+
+	/* start is 0 when timing was turned on in between */
+	if (!static_branch_unlikely(&pcc_timing) || !start)
+		return;
+
+	ns = local_clock() - start;
+	this_cpu_inc(pcc_times.hist[time][ns ? min_t(int, ilog2(ns) + 1,
+						    PCC_TIME_BUCKETS - 1) : 0]);
+}
+
+#define pcc_timed(time, call)				\
+	do {						\
+		u64 __start = pcc_time_start();		\
+							\
+		call;					\
+		pcc_time_end(time, __start);		\
+	} while (0)
 
-	// debug helpers
-	int id;
-	int intervals_count;
+/* One line per timed site, its buckets from the shortest */
+static int pcc_times_show(struct seq_file *seq, void *v)
+{
+	u64 sum[PCC_TIME_BUCKETS];
+	int cpu, i, j;
+
+	seq_printf(seq, "enabled %d\n", static_key_enabled(&pcc_timing));
+	for (i = 0; i < PCC_TIMES; i++) {
+		memset(sum, 0, sizeof(sum));
+		for_each_possible_cpu(cpu) {
+			const struct pcc_times *times = per_cpu_ptr(&pcc_times,
+								    cpu);
+
+			for (j = 0; j < PCC_TIME_BUCKETS; j++)
+				sum[j] += times->hist[i][j];
+		}
+
+		seq_printf(seq, "%s", pcc_time_names[i]);
+		for (j = 0; j < PCC_TIME_BUCKETS; j++)
+			seq_printf(seq, " %llu", sum[j]);
+		seq_putc(seq, '\n');
+	}
+	return 0;
+}
+
+static int pcc_times_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, pcc_times_show, NULL);
+}
+
+static ssize_t pcc_times_write(struct file *file, const char __user *buf,
+			       size_t count, loff_t *ppos)
+{
+	bool enable;
+	int ret;
 
-	u32 segs_sent;
-	u32 packets_counted;
-	u32 double_counted;
+	ret = kstrtobool_from_user(buf, count, &enable);
+	if (ret)
+		return ret;
 
+	if (enable)
+		static_branch_enable(&pcc_timing);
+	else
+		static_branch_disable(&pcc_timing);
+	return count;
+}
+
+static const struct file_operations pcc_times_fops = {
+	.owner = THIS_MODULE,
+	.open = pcc_times_open,
+	.read = seq_read,
+	.write = pcc_times_write,
+	.llseek = seq_lseek,
+	.release = single_release,
 };
 
 /*********************
  * Getters / Setters *
  * ******************/
+/* Rates are not allowed to grow beyond what the socket can be paced at */
+static u32 pcc_rate_max(struct sock *sk)
+{
+	u64 max_rate = (u64)sk->sk_max_pacing_rate >> PCC_RATE_SHIFT;
+
+	return min_t(u64, max_rate, U32_MAX);
+}
+
+static u32 pcc_rate_cap(struct sock *sk, u64 rate)
+{
+	return min_t(u64, rate, pcc_rate_max(sk));
+}
+
+/* returns 0 if the interval is still being sent */
+static u32 pcc_interval_end(struct pcc_data *pcc, int index)
+{
+	u32 sent = (pcc->state.send_index - index) & PCC_INDEX_MASK;
+
+	if (!sent)
+		return 0;
+	if (sent == 1)
+		return pcc->delivered_end;
+	return pcc->intervals[PCC_SLOT(index + 1)].delivered_start;
+}
+
+static u32 pcc_interval_lost(struct pcc_data *pcc, struct tcp_sock *tsk)
+{
+	return pcc->counting ? tsk->lost - pcc->lost_base : 0;
+}
+
+static u32 pcc_interval_delivered(struct pcc_data *pcc, struct tcp_sock *tsk)
+{
+	return pcc->counting ? tsk->delivered - pcc->delivered_base : 0;
+}
+
+/* The time the acks of the receive interval took so far */
+static u32 pcc_interval_time(struct pcc_data *pcc, struct tcp_sock *tsk)
+{
+	return (u32)tsk->tcp_mstamp - pcc->counting_mstamp;
+}
+
 static u32 pcc_get_rtt(struct tcp_sock *tp)
 {
         /* Get initial RTT - as measured by SYN -> SYN-ACK.
@@ -114,298 +400,646 @@ static u32 pcc_get_rtt(struct tcp_sock *tp)
         }
 }
 
+static void pcc_rtt_reset(struct pcc_data *pcc)
+{
+	pcc->rtt_samples = 0;
+	pcc->rtt_min = U32_MAX;
+	pcc->rtt_sum = 0;
+	pcc->rtt_index_sum = 0;
+}
+
+/* Adds an ack of the receive interval. Once the sums are full, the rest of the
+ * interval only updates the min */
+static void pcc_rtt_sample(struct pcc_data *pcc, const struct rate_sample *rs)
+{
+	u32 rtt;
+
+	if (rs->rtt_us <= 0)
+		return;
+	rtt = rs->rtt_us;
+
+	pcc->rtt_min = min(pcc->rtt_min, rtt);
+	if (pcc->rtt_samples == PCC_RTT_SAMPLES_MAX ||
+	    pcc->rtt_sum > U32_MAX - rtt)
+		return;
+	pcc->rtt_index_sum += (u64)pcc->rtt_samples * rtt;
+	pcc->rtt_sum += rtt;
+	pcc->rtt_samples++;
+}
+
+/* 0 if there were no samples */
+static u32 pcc_rtt_mean(struct pcc_data *pcc)
+{
+	return pcc->rtt_samples ? pcc->rtt_sum / pcc->rtt_samples : 0;
+}
+
+/* Should be called whenever the pacing rate changes */
+static void pcc_update_cwnd_gain(struct sock *sk, struct pcc_data *pcc)
+{
+	u64 gain = (u64)sk->sk_pacing_rate << PCC_CWND_GAIN_SHIFT;
+
+	gain = div64_u64(gain, (u64)tcp_sk(sk)->mss_cache * USEC_PER_SEC);
+	pcc->cwnd_gain = min_t(u64, gain, U32_MAX);
+	pcc->cwnd_mss = tcp_sk(sk)->mss_cache;
+}
+
+/* The RTT cwnd covers. The BDP at the pacing rate is what pacing keeps in
+ * flight, cwnd only adds the headroom the acks need to keep it there: the RTT
+ * variance, and the ACK aggregation measured by pcc_ack_aggregation(). It is at
+ * most the RTT, so pacing stays the limit and the queue small */
+static u32 pcc_cwnd_rtt(struct pcc_data *pcc, struct tcp_sock *tp)
+{
+	u32 rtt = pcc_get_rtt(tp);
+	u64 headroom;
+
+	/* mdev_us is 4 times the mean deviation */
+	headroom = (tp->mdev_us >> 2) +
+		   ((u64)rtt * pcc->cwnd_extra >> PCC_CWND_EXTRA_SHIFT);
+	return min_t(u64, rtt + min_t(u64, headroom, rtt), PCC_CWND_RTT_MAX);
+}
+
 /* Initialize cwnd to support current pacing rate (but not less then 4 packets)
- */
+ * over pcc_cwnd_rtt() */
 static void pcc_set_cwnd(struct sock *sk)
 {
+	struct pcc_data *pcc = inet_csk_ca(sk);
 	struct tcp_sock *tp = tcp_sk(sk);
-        u64 cwnd = sk->sk_pacing_rate;
+	u64 cwnd;
 
-        cwnd *= pcc_get_rtt(tcp_sk(sk));
-	cwnd /= tp->mss_cache;
-        cwnd /= USEC_PER_SEC;
-        cwnd *= 2;
+	pcc->cwnd_rtt = pcc_cwnd_rtt(pcc, tp);
+	cwnd = (u64)pcc->cwnd_gain * pcc->cwnd_rtt;
+        cwnd >>= PCC_CWND_GAIN_SHIFT;
 	cwnd = max(4ULL, cwnd);
         cwnd = min((u32)cwnd, tp->snd_cwnd_clamp); /* apply cap */	
-        tp->snd_cwnd = cwnd;
+        tcp_snd_cwnd_set(tp, cwnd);
 }
 
+/* cwnd only depends on the pacing rate, mss and pcc_cwnd_rtt(): the RTT, its
+ * deviation and the ACK aggregation headroom. The rate is only changed at the
+ * start of intervals (which sets cwnd), so on acks skip the update unless one
+ * of the others changed meaningfully */
+static void pcc_update_cwnd(struct sock *sk, struct pcc_data *pcc)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	u32 rtt = pcc_cwnd_rtt(pcc, tp);
 
-/* was the pcc struct fully inited */
-static bool pcc_valid(struct pcc_data *pcc)
+	if (tp->mss_cache != pcc->cwnd_mss) {
+		pcc_update_cwnd_gain(sk, pcc);
+	} else if (abs((s32)(rtt - pcc->cwnd_rtt)) <=
+		   pcc->cwnd_rtt >> pcc_cwnd_rtt_band) {
+		pcc_stats_inc(PCC_STAT_CWND_SKIPPED);
+		return;
+	}
+
+	pcc_stats_inc(PCC_STAT_CWND_UPDATES);
+	pcc_set_cwnd(sk);
+}
+
+/* Debug builds (CONFIG_TCP_PCC_DEBUG) count the intervals and decisions of a
+ * flow for the tracepoints and inet_diag. Other builds report 0 */
+static int pcc_intervals_count(struct pcc_data *pcc)
 {
-	return (pcc && pcc->intervals);
+#ifdef CONFIG_TCP_PCC_DEBUG
+	return pcc->intervals_count;
+#else
+	return 0;
+#endif
 }
 
-/******************
- * Intervals init *
- * ****************/
-static void pcc_setup_decision_making_intervals(struct pcc_data *pcc)
+static void pcc_count_interval(struct pcc_data *pcc)
 {
-	u64 rate_low, rate_high;
-	char rand;
-	int i;
+#ifdef CONFIG_TCP_PCC_DEBUG
+	pcc->intervals_count++;
+#endif
+}
 
-	get_random_bytes(&rand, 1);
-	rate_high = pcc->rate * (pcc_epsilon_part + pcc->epsilon);
-	rate_low = pcc->rate * (pcc_epsilon_part - pcc->epsilon);
+/* was the pcc struct fully inited. icsk_ca_priv is zeroed until pcc_init(),
+ * but set_state may be called before it (SYN timeouts) */
+static bool pcc_valid(struct pcc_data *pcc)
+{
+	return pcc->inited;
+}
 
-	rate_high /= pcc_epsilon_part;
-	rate_low /= pcc_epsilon_part;
+/*************************
+ * Per destination rates *
+ * ***********************/
+/* The rate flows converged to is kept when they close, and then the next flows
+ * to the same destination start from it in decision making. The cache is a
+ * direct mapped table, an entry is replaced by any other destination that
+ * hashes to it, and is taken no longer than dst_cache_timeout */
+#define PCC_DST_CACHE_BITS 10
+
+struct pcc_dst {
+	struct in6_addr addr;	/* IPv4 ones mapped */
+	u32 rate;
+	u32 min_rtt;		/* usec */
+	unsigned long stamp;	/* jiffies */
+	struct rcu_head rcu;
+};
 
-	for (i = 0; i < pcc_intervals; i += 2) {
-		if ((rand >> (i / 2)) & 1) {
-			pcc->intervals[i].rate = rate_low;
-			pcc->intervals[i + 1].rate = rate_high;
-		} else {
-			pcc->intervals[i].rate = rate_high;
-			pcc->intervals[i + 1].rate = rate_low;
-		}
+static struct pcc_dst __rcu *pcc_dst_cache[1 << PCC_DST_CACHE_BITS];
 
-		pcc->intervals[i].segs_sent_start = 0;
-		pcc->intervals[i + 1].segs_sent_start = 0;
+static void pcc_dst_addr(struct sock *sk, struct in6_addr *addr)
+{
+#if IS_ENABLED(CONFIG_IPV6)
+	if (sk->sk_family == AF_INET6) {
+		*addr = sk->sk_v6_daddr;
+		return;
 	}
+#endif
+	ipv6_addr_set_v4mapped(sk->sk_daddr, addr);
 }
 
-static void pcc_setup_intervals(struct pcc_data *pcc)
+static struct pcc_dst __rcu **pcc_dst_slot(const struct in6_addr *addr)
 {
-	switch (pcc->mode) {
-	case PCC_DECISION_MAKING:
-		pcc_setup_decision_making_intervals(pcc);
-		break;
-	case PCC_RATE_ADJUSMENT:
-	case PCC_SLOW_START:
-		pcc->single_interval->rate = pcc->rate;
-	default:
-		break;
-	}
-	pcc->send_index = 0;
-	pcc->recive_index = 0;
-	pcc->wait_mode = false;
+	return &pcc_dst_cache[hash_32(ipv6_addr_hash(addr),
+				      PCC_DST_CACHE_BITS)];
 }
 
-static void pcc_start_interval(struct sock *sk, struct pcc_data *pcc)
+/* Entries are replaced with xchg(), so closing flows never wait for each
+ * other, and freed once the readers are done with them. A rate is only kept
+ * with the min RTT it was found at, the flow may have none (~0U) */
+static void pcc_dst_save(struct sock *sk, u32 rate)
 {
-	struct pcc_interval *interval;
-	u64 rate = pcc->rate;
-
-	if (!pcc->wait_mode) {
-		interval = &pcc->intervals[pcc->send_index];
-		interval->segs_sent_end = 0;
-		interval->lost = 0;
-		interval->delivered = 0;
-		interval->segs_sent_start = tcp_sk(sk)->data_segs_out;
-		interval->segs_sent_start = max(interval->segs_sent_start, 1U);
-		rate = interval->rate;
-	}
+	u32 min_rtt = tcp_min_rtt(tcp_sk(sk));
+	struct pcc_dst *dst, *old;
 
-	rate = min(rate, (u64)sk->sk_max_pacing_rate);
-	rate = max(rate, pcc_rate_minimum);
-	sk->sk_pacing_rate = rate;
-	pcc_set_cwnd(sk);
+	if (!min_rtt || min_rtt == ~0U)
+		return;
+	dst = kmalloc(sizeof(*dst), GFP_ATOMIC);
+	if (!dst)
+		return;
+
+	pcc_dst_addr(sk, &dst->addr);
+	dst->rate = rate;
+	dst->min_rtt = min_rtt;
+	dst->stamp = jiffies;
+	old = xchg((__force struct pcc_dst **)pcc_dst_slot(&dst->addr), dst);
+	if (old)
+		kfree_rcu(old, rcu);
 }
 
-/************************
- * Utility and decisions *
- * **********************/
-/* get x = number * pcc_rounding_factor, return 
- * (e ^ number) * pcc_rounding_factor
- */
-static u32 pcc_exp(s32 x)
+/* A kept rate is only taken over a path of about the same RTT: the handshake
+ * RTT is at most twice the min RTT the rate was found at. 0 if there is none */
+static u32 pcc_dst_rate(struct sock *sk, const struct pcc_params *params)
+{
+	unsigned long timeout = params->dst_cache_timeout * HZ;
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct in6_addr addr;
+	struct pcc_dst *dst;
+	u32 rate = 0;
+
+	if (!timeout || !tp->srtt_us)
+		return 0;
+
+	pcc_dst_addr(sk, &addr);
+	rcu_read_lock();
+	dst = rcu_dereference(*pcc_dst_slot(&addr));
+	if (dst && ipv6_addr_equal(&dst->addr, &addr) &&
+	    time_before(jiffies, dst->stamp + timeout) &&
+	    pcc_get_rtt(tp) <= 2ULL * dst->min_rtt)
+		rate = dst->rate;
+	rcu_read_unlock();
+	return rate;
+}
+
+static void pcc_dst_cache_free(void)
 {
-	s64 temp = pcc_rounding_factor;
-	s64 exp = pcc_rounding_factor;
 	int i;
 
-	for (i = 1; temp != 0; i++) {
-		temp *= x;
-		temp /= i;
-		temp /= pcc_rounding_factor;
-		exp += temp;
-	}
-	return exp;
+	for (i = 0; i < ARRAY_SIZE(pcc_dst_cache); i++)
+		kfree(rcu_dereference_protected(pcc_dst_cache[i], true));
 }
 
-static void pcc_calc_utility(struct pcc_interval *interval)
+/****************
+ * Shared paths *
+ * **************/
+/* The live flows of a namespace to one destination most likely share their
+ * bottleneck. With path_share, they keep a common view of it:
+ * - a new flow joins at its fair share of the rate the others are at, instead
+ *   of slow starting into a loaded bottleneck
+ * - the min RTT is of all of them, so flows that started after the queue built
+ *   up don't take it for the propagation delay (pcc_delay_utility())
+ * Paths are a direct mapped table, destinations that hash together share one.
+ * Its values are only hints, so they are updated without locking */
+#define PCC_PATH_BITS 8
+
+/* Rates of the flows are averaged in steps of 1/2^PCC_PATH_RATE_SHIFT. Only
+ * the rates of decision making and rate adjustment are, not the probes of slow
+ * start */
+#define PCC_PATH_RATE_SHIFT 3
+
+struct pcc_path {
+	atomic_t flows;
+	u32 rate;		/* in PCC_RATE_UNIT bytes/sec, see above */
+	u32 min_rtt;		/* usec, 0 if there is none yet */
+} ____cacheline_aligned_in_smp;
+
+static struct pcc_path pcc_paths[1 << PCC_PATH_BITS];
+
+static struct pcc_path *pcc_path(struct sock *sk)
 {
-	s64 loss_ratio, delivered, lost, rate, util;
+	struct in6_addr addr;
+	u32 hash;
 
-	lost = interval->lost;
-	delivered = interval->delivered;
-	rate = interval->rate;
-	if (!(lost+ delivered)) {
-		interval->utility = S64_MIN;
-		return;
+	pcc_dst_addr(sk, &addr);
+	hash = ipv6_addr_hash(&addr) ^ net_hash_mix(sock_net(sk));
+	return &pcc_paths[hash_32(hash, PCC_PATH_BITS)];
+}
+
+/* Returns the fair share of the flows already on the path, 0 if there are
+ * none */
+static u32 pcc_path_join(struct sock *sk)
+{
+	struct pcc_path *path = pcc_path(sk);
+	u32 others = atomic_inc_return(&path->flows) - 1;
+
+	if (!others)
+		return 0;
+	return div_u64((u64)READ_ONCE(path->rate) * others, others + 1);
+}
+
+static void pcc_path_leave(struct sock *sk)
+{
+	struct pcc_path *path = pcc_path(sk);
+
+	if (atomic_dec_and_test(&path->flows)) {
+		WRITE_ONCE(path->rate, 0);
+		WRITE_ONCE(path->min_rtt, 0);
 	}
+}
 
-	/* loss rate = lost packets / all packets counted *100 * FACTOR_1 */
-	loss_ratio = (lost * pcc_rounding_factor * pcc_alpha) /
-		     (lost+ delivered);
-	
-	/* util = delivered rate / (1 + e^(100*loss_rate)) - lost_ratio * rate
-	 */
-	util = loss_ratio- (pcc_loss_margin * pcc_rounding_factor);
-	if (util < pcc_max_loss*pcc_rounding_factor)
-		util = (rate * pcc_rounding_factor) /
-		       (pcc_exp(util) + pcc_rounding_factor);
-	else
-		util = 0;
+static void pcc_path_update_rate(struct sock *sk, u32 rate)
+{
+	struct pcc_path *path = pcc_path(sk);
+	s64 avg = READ_ONCE(path->rate);
 
-	/* util *= goodput */
-	util *= (pcc_rounding_factor * pcc_alpha) - loss_ratio;
-	util /= pcc_rounding_factor * pcc_alpha;
-	/* util -= "wasted rate" */
-	util -= (rate * loss_ratio) / (pcc_alpha * pcc_rounding_factor);
+	avg = avg ? avg + (((s64)rate - avg) >> PCC_PATH_RATE_SHIFT) : rate;
+	WRITE_ONCE(path->rate, avg);
+}
+
+static void pcc_path_update_rtt(struct sock *sk, u32 rtt)
+{
+	struct pcc_path *path = pcc_path(sk);
+	u32 min_rtt = READ_ONCE(path->min_rtt);
 
-	printk(KERN_INFO
-		"rate %lld sent %u delv %lld lost %lld util %lld \n",
-		 rate, interval->segs_sent_end - interval->segs_sent_start,
-		 delivered, lost, util);
-	interval->utility = util;
+	if (!min_rtt || rtt < min_rtt)
+		WRITE_ONCE(path->min_rtt, rtt);
 }
 
-static void pcc_increase_epsilon(struct pcc_data *pcc)
+static u32 pcc_min_rtt(struct sock *sk, struct pcc_data *pcc)
 {
-	if (pcc->epsilon < pcc_epsilon_max)
-		pcc->epsilon++;
+	u32 min_rtt = tcp_min_rtt(tcp_sk(sk)), path_rtt;
+
+	if (!pcc->shared)
+		return min_rtt;
+	path_rtt = READ_ONCE(pcc_path(sk)->min_rtt);
+	return path_rtt ? min(min_rtt, path_rtt) : min_rtt;
 }
 
-static enum PCC_DECISION
-pcc_get_decision(struct pcc_data *pcc, u64 new_rate)
+/******************
+ * Intervals init *
+ * ****************/
+/* The order of a pair, see pcc_setup_pair(). It only has to be unbiased, not
+ * unpredictable. So the bits come from pcc_random_u32(), 31 pairs at a time per
+ * cpu, and the pool needs no locking: the top set bit ends it, so a racing ack
+ * at worst reuses a bit */
+static DEFINE_PER_CPU(u32, pcc_random_bits);
+
+static bool pcc_random_bit(void)
 {
-	if (pcc->rate == new_rate)
-		return PCC_RATE_STAY;
+	u32 bits = this_cpu_read(pcc_random_bits);
 
-	return pcc->rate < new_rate ? PCC_RATE_UP : PCC_RATE_DOWN;
+	if (bits <= 1)
+		bits = pcc_random_u32() | 1U << 31;
+	this_cpu_write(pcc_random_bits, bits >> 1);
+	return bits & 1;
 }
 
-static void
-pcc_change_epsilon_after_dicision(struct pcc_data *pcc, u64 new_rate)
+/* Scale the intervals of the next round to last pcc_interval_rtts RTTs at the
+ * current rate */
+static void pcc_setup_interval_scale(struct sock *sk, struct pcc_data *pcc,
+				     const struct pcc_params *params)
 {
-	enum PCC_DECISION decision = pcc_get_decision(pcc, new_rate);
+	struct tcp_sock *tp = tcp_sk(sk);
+	u32 rtt = min(pcc_get_rtt(tp), PCC_CWND_RTT_MAX);
+	u64 segs;
+
+	/* below 2^36 bytes/sec times 2^23 usecs */
+	segs = pcc_rate_bytes(pcc->state.rate) * rtt * pcc_interval_rtts;
+	segs = div64_u64(segs, (u64)tp->mss_cache * USEC_PER_SEC);
+	segs = DIV_ROUND_UP_ULL(segs, params->interval_min_segs);
+	pcc->interval_scale = clamp_t(u64, segs, 1, U16_MAX);
+}
 
-	if (decision == pcc->last_decision)
-		pcc_increase_epsilon(pcc);
-	else
-		pcc->epsilon = pcc_epsilon_min;
+static u32 pcc_interval_segs(struct pcc_data *pcc,
+			     const struct pcc_params *params)
+{
+	return params->interval_min_segs * pcc->interval_scale;
+}
 
-	pcc->last_decision = decision;
+static u32 pcc_ignore_segs(struct pcc_data *pcc,
+			   const struct pcc_params *params)
+{
+	return params->ignore_packets * pcc->interval_scale;
+}
+
+static void pcc_setup_intervals(struct sock *sk, struct pcc_data *pcc)
+{
+	int i;
+
+	pcc_reset_intervals(&pcc->state);
+	for (i = 0; i < PCC_INTERVALS; i++)
+		pcc->intervals[i].delivered_start = 0;
+	pcc->counting = false;
+	pcc_setup_interval_scale(sk, pcc, pcc_params_get());
 }
 
-static u64 pcc_decide_rate(struct pcc_data *pcc)
+/* An interval is sent for the time its segs take at its pacing rate. That is
+ * its segs, unless the application had less to send. Then it still ends in
+ * time, and is left out of the decisions (see pcc_data.app_limited). Outside
+ * of decision making, the ignored part at the end of the interval is dropped,
+ * as there is no next interval to keep apart from */
+static void pcc_set_send_end(struct sock *sk, struct pcc_data *pcc,
+			     const struct pcc_params *params, u64 pacing_rate)
 {
-	bool run_1_res, run_2_res, did_agree;
+	struct tcp_sock *tp = tcp_sk(sk);
+	u64 segs = pcc_interval_segs(pcc, params);
+	u64 time;
 
-	run_1_res = pcc->intervals[0].utility > pcc->intervals[1].utility;
-	run_2_res = pcc->intervals[2].utility > pcc->intervals[3].utility;
+	if (pcc->state.mode != PCC_DECISION_MAKING)
+		segs -= pcc_ignore_segs(pcc, params);
 
-	/* did_agree: was the 2 sets of intervals with the same result */
-	did_agree = !((run_1_res == run_2_res) ^ 
-		    (pcc->intervals[0].rate == pcc->intervals[2].rate));
-	if (did_agree)
-		pcc->mode = PCC_RATE_ADJUSMENT;
+	time = div64_u64(segs * tp->mss_cache * USEC_PER_SEC, pacing_rate);
+	time = min_t(u64, time, S32_MAX);
+	pcc->send_end_mstamp = (u32)tp->tcp_mstamp + time;
+}
 
-	if (did_agree)
-		return run_1_res ? pcc->intervals[0].rate :
-				   pcc->intervals[1].rate;
-	else
-		return pcc->rate;
+static void pcc_start_interval(struct sock *sk, struct pcc_data *pcc)
+{
+	const struct pcc_params *params = pcc_params_get();
+	struct pcc_interval *interval;
+	int slot = PCC_SLOT(pcc->state.send_index);
+	u32 rate = pcc->state.rate;
+	u64 pacing_rate;
+
+	if (!pcc->state.wait_mode) {
+		if (pcc->state.mode == PCC_DECISION_MAKING && !(slot & 1))
+			pcc_setup_pair(&pcc->state, slot,
+				       pcc_random_bit());
+		interval = &pcc->intervals[slot];
+		interval->delivered_start = max(tcp_sk(sk)->delivered, 1U);
+		rate = pcc_interval_rate(&pcc->state, slot);
+	}
+
+	pacing_rate = min_t(u64, pcc_rate_bytes(rate), sk->sk_max_pacing_rate);
+	pacing_rate = max(pacing_rate, pcc_rate_bytes(pcc_rate_minimum));
+	/* read locklessly by the pacing of fq, or of tcp itself (tcp_wstamp_ns
+	 * on EDT kernels) when there is no fq */
+	WRITE_ONCE(sk->sk_pacing_rate, pacing_rate);
+	pcc_update_cwnd_gain(sk, pcc);
+	pcc_set_cwnd(sk);
+
+	if (!pcc->state.wait_mode)
+		pcc_set_send_end(sk, pcc, params, pacing_rate);
+	if (pcc->shared && pcc->state.mode != PCC_SLOW_START)
+		pcc_path_update_rate(sk, pcc->state.rate);
 }
 
-static void pcc_decide(struct pcc_data *pcc, struct tcp_sock *tsk)
+/************************
+ * Utility and decisions *
+ * **********************/
+/* e^(-2^i / pcc_rounding_factor) in 1/2^32, rounded from double precision. The
+ * self-test's reference takes e^-x as their product over the bits of x, so
+ * shares nothing with the series the table is built from */
+static const u32 pcc_exp_bits[] __initconst = {
+	4290674475, 4286385946, 4277821741, 4260744631, 4226794655,
+	4159704096, 4028700796, 3778941489, 3324914438, 2573955809,
+	1542560875, 554019132, 71464385, 1189103,
+};
+
+/* 1 / (1 + e^x) in 1/2^(PCC_SIGMOID_SHIFT + PCC_SIGMOID_TEST_SHIFT), within
+ * 1/2^8 of it */
+static u32 __init pcc_sigmoid_reference(s32 x)
 {
-	u64 new_rate;
+	u64 one = 1ULL << 32, exp = one;
 	int i;
 
-	for (i = 0; i < pcc_intervals; i++ )
-		pcc_calc_utility(&pcc->intervals[i]);
+	BUILD_BUG_ON(PCC_SIGMOID_LIMIT > 1 << ARRAY_SIZE(pcc_exp_bits));
+	for (i = 0; i < ARRAY_SIZE(pcc_exp_bits); i++)
+		if (abs(x) & (1 << i))
+			exp = (exp * pcc_exp_bits[i]) >> 32;
+	/* exp = e^-|x|, 1 / (1 + e^x) is exp / (1 + exp) for x >= 0 */
+	return div64_u64((x >= 0 ? exp : one) <<
+			 (PCC_SIGMOID_SHIFT + PCC_SIGMOID_TEST_SHIFT),
+			 one + exp);
+}
 
-	new_rate = pcc_decide_rate(pcc);
-	pcc_change_epsilon_after_dicision(pcc, new_rate);
+/* Check the interpolated table against an independent reference, over all of
+ * its range. Beyond it the sigmoid is clamped to the table's ends */
+static int __init pcc_sigmoid_selftest(void)
+{
+	s32 x, err, max_err = 0;
 
-	if (new_rate != pcc->rate)
-		printk(KERN_INFO "%d decide: on new rate %d %lld (%d) %d\n",
-		       pcc->id, pcc->rate < new_rate, new_rate,
-		       pcc->intervals_count, pcc_get_rtt(tsk));
-	else
-		printk(KERN_INFO "%d decide: stay %lld (%d) %d\n", pcc->id,
-			pcc->rate, pcc->intervals_count, pcc_get_rtt(tsk));
-
-	if (pcc->mode == PCC_RATE_ADJUSMENT) {
-		pcc->last_rate = new_rate;
-		pcc->rate = new_rate;
-		new_rate *= pcc->epsilon;
-		new_rate /= pcc_epsilon_part;
-		if (pcc->last_decision == PCC_RATE_DOWN)
-			pcc->rate -= new_rate;
-		else
-			pcc->rate += new_rate;
+	for (x = -PCC_SIGMOID_LIMIT; x < PCC_SIGMOID_LIMIT; x++) {
+		err = abs((s32)(pcc_sigmoid(x) << PCC_SIGMOID_TEST_SHIFT) -
+			  (s32)pcc_sigmoid_reference(x));
+		max_err = max(max_err, err);
+	}
+
+	if (max_err > PCC_SIGMOID_MAX_ERROR) {
+		printk(KERN_ERR "pcc: sigmoid table error %d/%d above %d/%d\n",
+		       max_err, 1 << PCC_SIGMOID_TEST_SHIFT,
+		       PCC_SIGMOID_MAX_ERROR, 1 << PCC_SIGMOID_TEST_SHIFT);
+		return -EINVAL;
 	}
-	pcc->intervals_count += pcc_intervals;
+	return 0;
 }
 
+/* How fast the RTT grew while the receive interval was counted, in
+ * 1/2^PCC_GRADIENT_SHIFT usecs per usec. It is the least squares slope of the
+ * RTT samples over their index, times the samples per usec of the acks:
+ * 12 * (sum(i * rtt) - (n - 1) / 2 * sum(rtt)) / ((n^2 - 1) * time) */
+static s32 pcc_rtt_gradient(struct pcc_data *pcc, u32 time)
+{
+	u64 n = pcc->rtt_samples, div;
+	s64 num, gradient;
+	int shift;
+
+	if (n < 2 || !time)
+		return 0;
+
+	num = 6 * (2 * (s64)pcc->rtt_index_sum - (s64)(n - 1) * pcc->rtt_sum);
+	div = (n * n - 1) * time;
+
+	/* keep num << PCC_GRADIENT_SHIFT within s64 */
+	shift = max(fls64(abs(num)) + PCC_GRADIENT_SHIFT - 62, 0);
+	num >>= shift;
+	div >>= shift;
+	if (!div)
+		return 0;
 
-static void pcc_decide_rate_adjusment(struct pcc_data *pcc)
+	gradient = div64_s64(num << PCC_GRADIENT_SHIFT, div);
+	return pcc_gradient(gradient);
+}
+
+/* What the receive interval delivered over the time its acks took, in
+ * PCC_RATE_UNIT bytes/sec. Ack compression can make it look faster than it was
+ * sent, so it is capped by the sending rate */
+static u32 pcc_goodput(struct sock *sk, u32 delivered, u32 time, u32 rate)
 {
-	struct pcc_interval *interval = pcc->single_interval;
-	s64 prev, extra_rate;
+	u64 goodput = (u64)delivered * tcp_sk(sk)->mss_cache * USEC_PER_SEC;
 
-	prev = interval->utility;
-	pcc_calc_utility(interval);
+	if (!time)
+		return rate;
+	goodput = div_u64(goodput >> PCC_RATE_SHIFT, time);
+	return min_t(u64, goodput, rate);
+}
 
-	printk(KERN_INFO "%d: adj mode: rate %lld utility %lld (%d)\n",
-		pcc->id, interval->rate, interval->utility, pcc->intervals_count);
-	if (prev < interval->utility) {
-		pcc_increase_epsilon(pcc);
-		extra_rate = (pcc->rate * pcc->epsilon) / pcc_epsilon_part;
-		pcc->last_rate = pcc->rate;
-		if (pcc->last_decision == PCC_RATE_UP)
-			pcc->rate += extra_rate;
-		else
-			pcc->rate -= extra_rate;
-	} else {
-		pcc->rate = pcc->last_rate;
-		pcc->epsilon = pcc_epsilon_min;
-		pcc->mode = PCC_DECISION_MAKING;
-		printk(KERN_INFO "%d: adj mode ended\n", pcc->id);
+/* Calculates the utility of the receive interval into pcc->state.utility.
+ * Should be called when it ended, before the lost / delivered bases move to the
+ * next one */
+static void pcc_calc_utility(struct sock *sk, struct pcc_data *pcc,
+			     const struct pcc_params *params, int index)
+{
+	s64 delivered, lost, rate, util;
+	u32 loss_ratio, time, goodput, min_rtt;
+	s32 gradient;
+
+	lost = pcc_interval_lost(pcc, tcp_sk(sk));
+	delivered = pcc_interval_delivered(pcc, tcp_sk(sk));
+	rate = pcc_interval_rate(&pcc->state, PCC_SLOT(index));
+	/* an app limited interval wasn't sent at its rate, it says nothing of
+	 * the rate */
+	if (!(lost+ delivered) || pcc->app_limited) {
+		pcc->state.utility = S32_MIN;
+		return;
 	}
-	pcc->intervals_count++;
+	time = pcc_interval_time(pcc, tcp_sk(sk));
+	goodput = pcc_goodput(sk, delivered, time, rate);
+	gradient = pcc_rtt_gradient(pcc, time);
+	if (pcc->shared && pcc->rtt_samples)
+		pcc_path_update_rtt(sk, pcc->rtt_min);
+
+	/* loss rate = lost packets / all packets counted. The only division
+	 * of the utility, the other factors are powers of two or constants */
+	loss_ratio = div_u64((u64)lost << PCC_LOSS_SHIFT, lost + delivered);
+
+	/* only the delay penalty takes the path's min RTT */
+	min_rtt = pcc->state.delay ? pcc_min_rtt(sk, pcc) : 0;
+	util = pcc_utility(&pcc->state, params, rate, goodput, loss_ratio,
+			   gradient, pcc_rtt_mean(pcc), min_rtt);
+	/* The trace has Allegro utilities in bytes/sec, Vivace ones as they
+	 * are */
+	trace_pcc_interval(sk, pcc_rate_bytes(rate), pcc_rate_bytes(goodput),
+			   delivered, lost,
+			   pcc->state.vivace ? util : util * PCC_RATE_UNIT,
+			   pcc->rtt_min, pcc_rtt_mean(pcc), gradient);
+	pcc->state.utility = clamp_t(s64, util, S32_MIN + 1, S32_MAX);
+}
+
+/* The decisions are taken in pcc_core.h, on the utility of the receive
+ * interval. Here they are counted and traced */
+
+/* A pair of decision making intervals ending at slot was received, first is
+ * the utility of the first interval of the pair */
+static void pcc_pair_received(struct sock *sk, struct pcc_data *pcc,
+			      const struct pcc_params *params, int slot,
+			      s32 first)
+{
+	struct pcc_state *s = &pcc->state;
+	u32 prev_rate = s->rate;
+	int decision;
+
+	decision = pcc_decide(s, params, slot, first, pcc_rate_max(sk));
+	/* set only by the pair that was just received */
+	if (s->split)
+		pcc_stats_inc(PCC_STAT_DISAGREEMENTS);
+	if (decision < 0)
+		return;
+
+	pcc_stats_inc(PCC_STAT_DECISIONS_UP + decision);
+	if (s->mode != PCC_DECISION_MAKING)
+		trace_pcc_mode(sk, PCC_DECISION_MAKING, s->mode);
+	trace_pcc_decision(sk, PCC_DECISION_MAKING, pcc_rate_bytes(prev_rate),
+			   pcc_rate_bytes(s->rate), 0, s->epsilon,
+			   pcc_intervals_count(pcc), pcc_get_rtt(tcp_sk(sk)));
 }
 
-static s64 pcc_adjust_utility(s64 utility, u32 rate, bool threshold)
+static void pcc_vivace_pair_received(struct sock *sk, struct pcc_data *pcc,
+				     int slot, s32 first)
 {
-	if (utility == S64_MIN)
-		return S64_MIN;
+	struct pcc_state *s = &pcc->state;
+	u32 prev_rate = s->rate;
+	int decision;
+	s64 step;
+
+	decision = pcc_vivace_decide(s, slot, first, pcc_rate_max(sk), &step);
+	if (s->split)
+		pcc_stats_inc(PCC_STAT_DISAGREEMENTS);
+	if (decision < 0)
+		return;
 
-	return utility * (threshold ? pcc_slow_start_threshold_base :
-					pcc_slow_start_threshold) / rate;
+	pcc_stats_inc(PCC_STAT_DECISIONS_UP + decision);
+	trace_pcc_decision(sk, PCC_DECISION_MAKING, pcc_rate_bytes(prev_rate),
+			   pcc_rate_bytes(s->rate), step, s->epsilon,
+			   pcc_intervals_count(pcc), pcc_get_rtt(tcp_sk(sk)));
 }
-static void pcc_decide_slow_start(struct pcc_data *pcc, struct tcp_sock *tsk)
+
+/* A decision of slow start or rate adjustment (mode) was taken */
+static void pcc_trace_adjusment(struct sock *sk, struct pcc_data *pcc,
+				enum PCC_MODE mode, u32 prev_rate)
 {
-	struct pcc_interval *interval = pcc->single_interval;
-	s64 adjust_utility, prev_adjust_utility;
-	u64 extra_rate;
+	struct pcc_state *s = &pcc->state;
+
+	/* set only by the interval that was just received */
+	if (s->doubt)
+		pcc_stats_inc(PCC_STAT_DOUBTS);
+	if (s->mode != mode)
+		trace_pcc_mode(sk, mode, s->mode);
+	trace_pcc_decision(sk, mode, pcc_rate_bytes(prev_rate),
+			   pcc_rate_bytes(s->rate),
+			   (s64)s->utility * PCC_RATE_UNIT, s->epsilon,
+			   pcc_intervals_count(pcc), pcc_get_rtt(tcp_sk(sk)));
+}
 
-	prev_adjust_utility = pcc_adjust_utility(interval->utility,
-						 pcc->last_rate,
-						 interval->utility < 0);
-	pcc_calc_utility(interval);
-	adjust_utility = pcc_adjust_utility(interval->utility, pcc->rate,
-					interval->utility < 0);
+static void pcc_rate_adjusment_received(struct sock *sk, struct pcc_data *pcc,
+					const struct pcc_params *params)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct pcc_state *s = &pcc->state;
+	u32 prev_rate = s->rate, lost, segs;
+	s32 prev = s->utility;
+
+	lost = pcc_interval_lost(pcc, tp);
+	segs = lost + pcc_interval_delivered(pcc, tp);
+	pcc_calc_utility(sk, pcc, params, 0);
+	if (!pcc_decide_rate_adjusment(s, params, prev, lost, segs,
+				       pcc_rate_max(sk)))
+		return;
 
-	printk(KERN_INFO "%d: start mode: rate %lld utility %lld (%lld, %lld)\n",
-		pcc->id, pcc->rate, interval->utility,
-		prev_adjust_utility, adjust_utility);
-	if (adjust_utility > prev_adjust_utility) {
-		pcc->last_rate = pcc->rate;
-		extra_rate = pcc->intervals[0].delivered * tsk->mss_cache;
-		extra_rate = min(extra_rate, pcc->rate);
-		pcc->rate += extra_rate;
-	} else {
-		pcc->rate = pcc->last_rate;
-		pcc->mode = PCC_DECISION_MAKING;
-		printk(KERN_INFO "%d: start mode ended\n", pcc->id);
-	}
+	pcc_trace_adjusment(sk, pcc, PCC_RATE_ADJUSMENT, prev_rate);
+	pcc_count_interval(pcc);
+}
+
+static void pcc_slow_start_received(struct sock *sk, struct pcc_data *pcc,
+				    const struct pcc_params *params)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct pcc_state *s = &pcc->state;
+	u32 prev_rate = s->rate, lost, delivered, goodput;
+	s32 prev = s->utility;
+
+	lost = pcc_interval_lost(pcc, tp);
+	delivered = pcc_interval_delivered(pcc, tp);
+	goodput = pcc_goodput(sk, delivered, pcc_interval_time(pcc, tp),
+			      s->rate);
+	pcc_calc_utility(sk, pcc, params, 0);
+	if (!pcc_decide_slow_start(s, params, prev, goodput, lost,
+				   lost + delivered, pcc_rate_max(sk)))
+		return;
+
+	pcc_trace_adjusment(sk, pcc, PCC_SLOW_START, prev_rate);
 }
 
 /**************************
@@ -413,141 +1047,305 @@ static void pcc_decide_slow_start(struct pcc_data *pcc, struct tcp_sock *tsk)
  * was started, was ended,
  * find interval per sample
  * ************************/
+/* Sends until pcc_data.send_end_mstamp, and until a packet of the interval was
+ * acked */
 bool send_interval_ended(struct pcc_interval *interval, struct tcp_sock *tsk,
-			 struct pcc_data *pcc)
+			 struct pcc_data *pcc, const struct rate_sample *rs)
 {
-	int segs_sent = tsk->data_segs_out - interval->segs_sent_start;
-
-	if (pcc->mode != PCC_DECISION_MAKING)
-		segs_sent += pcc_ignore_packets;
-
-	if (segs_sent < pcc_interval_min_segs)
+	if ((s32)((u32)tsk->tcp_mstamp - pcc->send_end_mstamp) < 0)
 		return false;
 
-	if (pcc->packets_counted > interval->segs_sent_start ) {
-		interval->segs_sent_end = tsk->data_segs_out;
+	if (after(rs->prior_delivered, interval->delivered_start)) {
+		pcc->delivered_end = max(tsk->delivered, 1U);
 		return true;
 	}
 	return false;
 }
 
-bool recive_interval_ended(struct pcc_interval *interval,
-			   struct tcp_sock *tsk, struct pcc_data *pcc)
+/* The ignored parts are in segs delivered while the interval was sent, and a
+ * lossy interval has fewer of them than it sent. Its end is put off to count at
+ * least an ignored part's worth of them, or it would be received with nothing
+ * counted, and slow start would go on at a rate that loses most of it */
+bool recive_interval_ended(struct pcc_data *pcc,
+			   const struct pcc_params *params, int index,
+			   const struct rate_sample *rs)
 {
-	return interval->segs_sent_end &&
-	       interval->segs_sent_end - pcc_ignore_packets <
-							pcc->packets_counted;
+	u32 delivered_end = pcc_interval_end(pcc, index);
+	u32 ignore = pcc_ignore_segs(pcc, params);
+	u32 end, counted;
+
+	if (!delivered_end)
+		return false;
+
+	end = delivered_end - ignore;
+	counted = pcc->intervals[PCC_SLOT(index)].delivered_start + 2 * ignore;
+	if (before(end, counted))
+		end = counted;
+	return after(rs->prior_delivered, end);
 }
 
 static void start_next_send_interval(struct sock *sk, struct pcc_data *pcc)
 {
-	pcc->send_index++;
-	if (pcc->send_index == pcc_intervals ||
-	    pcc->mode != PCC_DECISION_MAKING)
-		pcc->wait_mode = true;
-
+	pcc_next_send_interval(&pcc->state);
 	pcc_start_interval(sk, pcc);
 }
 
-static void
-pcc_update_interval(struct pcc_interval *interval,  struct pcc_data *pcc,
-		    struct sock *sk, const struct rate_sample *rs)
+/* see pcc_resume() */
+static void pcc_resume_sending(struct sock *sk, struct pcc_data *pcc)
 {
-	interval->lost += tcp_sk(sk)->lost - pcc->lost_base;
-	interval->delivered += tcp_sk(sk)->delivered - pcc->delivered_base;
+	if (pcc_resume(&pcc->state))
+		pcc_start_interval(sk, pcc);
 }
 
-static void pcc_process_sample(struct sock *sk, const struct rate_sample *rs)
+/* The ACK aggregation of the receive interval: how many segments its acks are
+ * ahead of the pacing rate since it started being counted. Like BBR's
+ * extra_acked, the most of it is kept as cwnd headroom (pcc->cwnd_extra), so
+ * bunched acks don't leave the flow cwnd limited. The pacing rate is of the
+ * interval being sent, not of the received one. In decision making they are up
+ * to two epsilons apart, so the acks of an interval at the higher rate count
+ * up to that difference as aggregation too */
+static void pcc_ack_aggregation(struct sock *sk, struct pcc_data *pcc)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	u64 bdp = (u64)pcc->cwnd_gain * pcc_get_rtt(tp);
+	u64 expected, extra;
+
+	if (pcc->cwnd_extra == PCC_CWND_EXTRA_MAX)
+		return;
+	expected = (u64)pcc->cwnd_gain * pcc_interval_time(pcc, tp);
+	extra = (u64)pcc_interval_delivered(pcc, tp) << PCC_CWND_GAIN_SHIFT;
+	if (extra <= expected || !bdp)
+		return;
+	extra -= expected;
+	if (extra <= (bdp >> PCC_CWND_EXTRA_SHIFT) * pcc->cwnd_extra)
+		return;
+
+	extra = div64_u64(extra << PCC_CWND_EXTRA_SHIFT, bdp);
+	pcc->cwnd_extra = min_t(u64, extra, PCC_CWND_EXTRA_MAX);
+	pcc_set_cwnd(sk);
+}
+
+/* Adds an ack of the receive interval, past its ignored part */
+static void pcc_count_sample(struct sock *sk, struct pcc_data *pcc,
+			     const struct rate_sample *rs)
+{
+	pcc_rtt_sample(pcc, rs);
+	if (rs->is_app_limited)
+		pcc->app_limited = true;
+	/* a retransmission was counted lost already, its delivery doesn't add
+	 * to the interval's */
+	if (rs->is_retrans) {
+		pcc->delivered_base += rs->acked_sacked;
+		pcc_stats_inc(PCC_STAT_RETRANS_DELIVERED);
+	}
+	pcc_ack_aggregation(sk, pcc);
+}
+
+/* Most acks cross no boundary: the send interval is not due to end, and they
+ * fall in the counted part of the receive interval, before its end. They only
+ * add to its counters. When the receive interval's end is not known yet (it is
+ * still being sent) it can't end */
+static bool pcc_fast_sample(struct sock *sk, struct pcc_data *pcc,
+			    const struct pcc_params *params,
+			    const struct rate_sample *rs)
 {
+	u32 now = tcp_sk(sk)->tcp_mstamp;
+
+	if (!pcc->counting || !rs->prior_mstamp)
+		return false;
+	if (!pcc->state.wait_mode && (s32)(now - pcc->send_end_mstamp) >= 0)
+		return false;
+	if (recive_interval_ended(pcc, params, pcc->state.recive_index, rs))
+		return false;
+
+	pcc_count_sample(sk, pcc, rs);
+	pcc_stats_inc(PCC_STAT_FAST_SAMPLES);
+	return true;
+}
+
+static void __pcc_process_sample(struct sock *sk, const struct rate_sample *rs)
+{
+	const struct pcc_params *params = pcc_params_get();
 	struct pcc_data *pcc = inet_csk_ca(sk);
 	struct tcp_sock *tsk = tcp_sk(sk);
 	struct pcc_interval *interval;
-	int index;
-	u32 before;
+	int index, slot;
+	s32 first;
+	u64 start;
 
 	if (!pcc_valid(pcc))
 		return;
 
-	pcc_set_cwnd(sk);
-	if (pcc->mode == PCC_LOSS)
+	pcc_update_cwnd(sk, pcc);
+	if (pcc_fast_sample(sk, pcc, params, rs))
+		return;
+
+	/* without a delivery rate sample, the ack can't be put in an
+	 * interval */
+	if (!rs->prior_mstamp)
 		goto end;
 
-	if (!pcc->wait_mode) {
-		if (send_interval_ended(&pcc->intervals[pcc->send_index], tsk,
-					pcc))
+	if (!pcc->state.wait_mode) {
+		slot = PCC_SLOT(pcc->state.send_index);
+		if (send_interval_ended(&pcc->intervals[slot], tsk, pcc, rs))
 			start_next_send_interval(sk, pcc);
 	}
 
-	index = pcc->recive_index;
-	interval = &pcc->intervals[index];
-	before = pcc->packets_counted;
-	pcc->packets_counted =  tsk->delivered + tsk->lost -
-				pcc->double_counted;
+	index = pcc->state.recive_index;
+	slot = PCC_SLOT(index);
+	interval = &pcc->intervals[slot];
 
-	if (!interval->segs_sent_start)
+	if (!interval->delivered_start)
 		goto end;
 
-	if (before > pcc_ignore_packets + interval->segs_sent_start)
-		pcc_update_interval(interval, pcc, sk, rs);
-	
-	if (recive_interval_ended(interval, tsk, pcc)) {
-		pcc->recive_index++;
-		switch (pcc->mode) {
+	/* count the interval from the ack after its ignored part */
+	if (after(rs->prior_delivered,
+		  pcc_ignore_segs(pcc, params) + interval->delivered_start))
+		pcc->counting = true;
+	if (pcc->counting)
+		pcc_count_sample(sk, pcc, rs);
+
+	if (recive_interval_ended(pcc, params, index, rs)) {
+		pcc->state.recive_index++;
+		pcc->cwnd_extra -= DIV_ROUND_UP(pcc->cwnd_extra,
+						1 << pcc_cwnd_extra_decay);
+		switch (pcc->state.mode) {
 		case PCC_SLOW_START:
-			pcc_decide_slow_start(pcc, tsk);
+			pcc_timed(PCC_TIME_SLOW_START,
+				  pcc_slow_start_received(sk, pcc, params));
 			break;
 		case PCC_RATE_ADJUSMENT:
-			pcc_decide_rate_adjusment(pcc);
+			pcc_timed(PCC_TIME_RATE_ADJUST,
+				  pcc_rate_adjusment_received(sk, pcc,
+							      params));
 			break;
 		case PCC_DECISION_MAKING:
-			if (pcc->recive_index == pcc_intervals)
-				pcc_decide(pcc, tsk);
-			else
+			start = pcc_time_start();
+			first = pcc->state.utility;
+			pcc_calc_utility(sk, pcc, params, index);
+			pcc_count_interval(pcc);
+			if ((slot & 1) && pcc->state.vivace)
+				pcc_vivace_pair_received(sk, pcc, slot, first);
+			else if (slot & 1)
+				pcc_pair_received(sk, pcc, params, slot,
+						  first);
+			pcc_time_end(PCC_TIME_DECIDE, start);
+
+			if (pcc->state.mode == PCC_DECISION_MAKING &&
+			    (pcc_pipelined(&pcc->state) ||
+			     (slot + 1) % pcc_round_intervals(&pcc->state))) {
+				pcc->counting = false;
+				pcc_resume_sending(sk, pcc);
 				goto end;
+			}
 		default:
 			break;
 		}
-		pcc_setup_intervals(pcc);
+		pcc_setup_intervals(sk, pcc);
 		pcc_start_interval(sk, pcc);
 
 	}
 
 end:
-	pcc->lost_base = tsk->lost;
-	pcc->delivered_base = tsk->delivered;
+	if (!pcc->counting) {
+		pcc->lost_base = tsk->lost;
+		pcc->delivered_base = tsk->delivered;
+		pcc->counting_mstamp = tsk->tcp_mstamp;
+		pcc->app_limited = false;
+		pcc_rtt_reset(pcc);
+	}
 }
 
-static void pcc_init(struct sock *sk)
+static void pcc_process_sample(struct sock *sk, const struct rate_sample *rs)
 {
-	struct pcc_data *pcc = inet_csk_ca(sk);
+	rcu_read_lock();
+	pcc_timed(PCC_TIME_SAMPLE, __pcc_process_sample(sk, rs));
+	rcu_read_unlock();
+	pcc_stats_inc(PCC_STAT_SAMPLES);
+}
 
-	pcc->intervals = kzalloc(sizeof(struct pcc_interval) *pcc_intervals,
-				 GFP_KERNEL);
-	if (!pcc->intervals) {
-		printk(KERN_INFO "init fails\n");
-		return;
+/* The CA is initialized once the connection is established, after
+ * tcp_init_metrics() set the RTT and initial window (from the route, if it has
+ * them) */
+static u32 pcc_initial_rate(struct sock *sk, const struct pcc_params *params)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	u64 rate = params->initial_rate;
+	u64 cwnd_rate;
+
+	if (tp->srtt_us) {
+		cwnd_rate = (u64)tcp_snd_cwnd(tp) * tp->mss_cache *
+			    USEC_PER_SEC;
+		cwnd_rate = div_u64(cwnd_rate, pcc_get_rtt(tp));
+		rate = max(rate, cwnd_rate);
 	}
+	return pcc_rate_cap(sk, rate >> PCC_RATE_SHIFT);
+}
 
-	pcc->single_interval = &pcc->intervals[0];
-	id++;
-	pcc->id = id;
-	pcc->epsilon = pcc_epsilon_min;
-	pcc->rate = pcc_rate_minimum*512;
-	pcc->last_rate = pcc_rate_minimum*512;
+static void pcc_init_common(struct sock *sk, bool vivace, bool delay)
+{
+	struct pcc_data *pcc = inet_csk_ca(sk);
+	const struct pcc_params *params;
+	enum PCC_MODE mode = PCC_DECISION_MAKING;
+	u32 rate;
+
+	memset(pcc, 0, sizeof(*pcc));
+	rcu_read_lock();
+	params = pcc_params_get();
+	rate = pcc_dst_rate(sk, params);
+	if (params->path_share) {
+		pcc->shared = true;
+		rate = pcc_path_join(sk) ?: rate;
+	}
+	rate = pcc_rate_cap(sk, rate);
+	if (!rate) {
+		rate = pcc_initial_rate(sk, params);
+		mode = PCC_SLOW_START;
+	}
+	pcc_init_state(&pcc->state, params, vivace, delay, rate, mode);
 	tcp_sk(sk)->snd_ssthresh = TCP_INFINITE_SSTHRESH;
-	pcc->mode = PCC_SLOW_START;
-	pcc->intervals[0].utility = S64_MIN;
+	pcc_rtt_reset(pcc);
 
-	pcc_setup_intervals(pcc);
+	pcc_setup_intervals(sk, pcc);
 	pcc_start_interval(sk,pcc);
+	rcu_read_unlock();
+	pcc->inited = true;
 	cmpxchg(&sk->sk_pacing_status, SK_PACING_NONE, SK_PACING_NEEDED);
 }
 
+static void pcc_init(struct sock *sk)
+{
+	pcc_init_common(sk, false, false);
+}
+
+static void pcc_vivace_init(struct sock *sk)
+{
+	pcc_init_common(sk, true, false);
+}
+
+static void pcc_delay_init(struct sock *sk)
+{
+	pcc_init_common(sk, false, true);
+}
+
+/* Only rates of decision making are kept: slow start did not converge, and the
+ * Loss state says nothing of the rate */
 static void pcc_release(struct sock *sk)
 {
 	struct pcc_data *pcc = inet_csk_ca(sk);
+	bool save;
 
-	kfree(pcc->intervals);
+	if (!pcc_valid(pcc))
+		return;
+
+	if (pcc->shared)
+		pcc_path_leave(sk);
+	rcu_read_lock();
+	save = pcc_params_get()->dst_cache_timeout;
+	rcu_read_unlock();
+	if (save && (pcc->state.mode == PCC_DECISION_MAKING ||
+		     pcc->state.mode == PCC_RATE_ADJUSMENT))
+		pcc_dst_save(sk, pcc->state.rate);
 }
 
 /* PCC does not need to undo the cwnd since it does not
@@ -555,7 +1353,7 @@ static void pcc_release(struct sock *sk)
  */
 static u32 pcc_undo_cwnd(struct sock *sk)
 {
-        return tcp_sk(sk)->snd_cwnd;
+        return tcp_snd_cwnd(tcp_sk(sk));
 }
 
 static u32 pcc_ssthresh(struct sock *sk)
@@ -566,37 +1364,87 @@ static u32 pcc_ssthresh(struct sock *sk)
 static void pcc_set_state(struct sock *sk, u8 new_state)
 {
 	struct pcc_data *pcc = inet_csk_ca(sk);
-	struct tcp_sock *tsk = tcp_sk(sk);
-	s32 double_counted;
 
 	if (!pcc_valid(pcc))
 		return;
 
-	/* In Loss state, the counters of sent segs versus segs recived, lost
-	 * and in flight, stops being in sync. So at the end of the loss state,
-	 * pcc saves the diff between the counters in order to resulves these
-	 * diffs in the future
-	 */
-	if (pcc->mode == PCC_LOSS && new_state != TCP_CA_Loss) {
-		double_counted = tsk->delivered + tsk->lost+
-				 tcp_packets_in_flight(tsk);
-		double_counted -= tsk->data_segs_out;
-		double_counted -= pcc->double_counted;
-		pcc->double_counted+= double_counted;
-		printk(KERN_INFO "%d loss ended: double_counted %d\n",
-		       pcc->id, double_counted);
-
-		pcc->mode = PCC_DECISION_MAKING;
-		pcc_setup_intervals(pcc);
-		pcc_start_interval(sk, pcc);
-	} else if (pcc->mode != PCC_LOSS && new_state  == TCP_CA_Loss) {
-		printk(KERN_INFO "%d loss: started\n", pcc->id);
-		pcc->mode = PCC_LOSS;
-		pcc->wait_mode = true;
-		pcc_start_interval(sk, pcc);
-	} else {
-		pcc_set_cwnd(sk);
+	/* Intervals are measured through the Loss state as through any other:
+	 * what tcp_enter_loss() marks lost at once counts against the interval
+	 * being received, and the deliveries of the retransmissions don't add
+	 * to it (see pcc_count_sample()). So decisions go on, and the rate is
+	 * only lowered if the utilities say so */
+	if (new_state == TCP_CA_Loss &&
+	    inet_csk(sk)->icsk_ca_state != TCP_CA_Loss)
+		pcc_stats_inc(PCC_STAT_LOSS_EPISODES);
+	pcc_set_cwnd(sk);
+}
+
+/* Segments the stack puts in a TSO/GSO burst. pcc_tso_burst_us of the pacing
+ * rate, as the stack's own sizing, so high rates are sent in few, large skbs.
+ * But no more than the ignored part of an interval: a burst across an interval
+ * boundary then has its acks left out of both intervals, and the accounting of
+ * send_interval_ended() stays accurate. At low rates bursts are of 2 segments,
+ * below pcc_tso_single_rate of one.
+ * Since 4.20 this is only a minimum (as for BBR) to the stack's own size of
+ * 2^-10 sec of the pacing rate. sk_pacing_shift is left at its default: a
+ * larger one would shrink the TSQ budget of the flow along with its bursts */
+static u32 pcc_tso_segs(struct sock *sk)
+{
+	struct pcc_data *pcc = inet_csk_ca(sk);
+	u64 rate = READ_ONCE(sk->sk_pacing_rate);
+	u32 min_segs = rate < pcc_tso_single_rate ? 1 : 2;
+	u64 segs;
+
+	segs = div_u64(rate * pcc_tso_burst_us, USEC_PER_SEC);
+	segs = min_t(u64, segs, sk->sk_gso_max_size - 1 - MAX_TCP_HEADER);
+	segs = div_u64(segs, tcp_sk(sk)->mss_cache);
+	if (pcc_valid(pcc)) {
+		rcu_read_lock();
+		segs = min_t(u64, segs, pcc_ignore_segs(pcc, pcc_params_get()));
+		rcu_read_unlock();
 	}
+	return max_t(u64, segs, min_segs);
+}
+
+/* Allegro utilities are kept in PCC_RATE_UNIT bytes/sec, see pcc_info.h */
+static s32 pcc_info_utility(const struct pcc_state *s)
+{
+	if (s->vivace || s->utility == S32_MIN)
+		return s->utility;
+	return clamp_t(s64, (s64)s->utility * PCC_RATE_UNIT, S32_MIN + 1,
+		       S32_MAX);
+}
+
+/* Reports the state of the flow to inet_diag, see pcc_info.h */
+static size_t pcc_get_info(struct sock *sk, u32 ext, int *attr,
+			   union tcp_cc_info *info)
+{
+	struct tcp_pcc_info *pcc_info = (struct tcp_pcc_info *)info;
+	struct pcc_data *pcc = inet_csk_ca(sk);
+
+	BUILD_BUG_ON(sizeof(struct tcp_pcc_info) > sizeof(union tcp_cc_info));
+
+	if (!(ext & (1 << (INET_DIAG_INFO - 1))))
+		return 0;
+
+	memset(pcc_info, 0, sizeof(*pcc_info));
+	pcc_info->pcc_rate = min_t(u64, pcc_rate_bytes(pcc->state.rate),
+				   U32_MAX);
+	pcc_info->pcc_last_rate = min_t(u64,
+					pcc_rate_bytes(pcc->state.last_rate),
+					U32_MAX);
+	pcc_info->pcc_utility = pcc_info_utility(&pcc->state);
+	pcc_info->pcc_intervals_count = pcc_intervals_count(pcc);
+	pcc_info->pcc_mode = inet_csk(sk)->icsk_ca_state == TCP_CA_Loss ?
+			     PCC_LOSS : pcc->state.mode;
+	pcc_info->pcc_epsilon = pcc->state.epsilon;
+	if (pcc->state.vivace)
+		pcc_info->pcc_flags |= PCC_INFO_VIVACE;
+	if (pcc->state.delay)
+		pcc_info->pcc_flags |= PCC_INFO_DELAY;
+
+	*attr = INET_DIAG_PCCINFO;
+	return sizeof(*pcc_info);
 }
 
 static void pcc_cong_avoid(struct sock *sk, u32 ack, u32 acked)
@@ -616,13 +1464,33 @@ static void pcc_cwnd_event(struct sock *sk, enum tcp_ca_event event)
 {
 }
 
+#ifdef PCC_CONG_CONTROL_ACK
+static void pcc_cong_control(struct sock *sk, u32 ack, int flag,
+			     const struct rate_sample *rs)
+{
+	pcc_process_sample(sk, rs);
+}
+#else
+#define pcc_cong_control pcc_process_sample
+#endif
+
+/* A build with PCC_VERSION (see the Makefile) registers as "pcc<version>". A
+ * new build can then be loaded next to the running one: new sockets are moved
+ * to it by net.ipv4.tcp_congestion_control, while the old one keeps its flows
+ * until they close and can then be removed */
+#ifdef PCC_VERSION
+#define PCC_NAME(name) "pcc" __stringify(PCC_VERSION) name
+#else
+#define PCC_NAME(name) "pcc" name
+#endif
+
 static struct tcp_congestion_ops tcp_pcc_cong_ops __read_mostly = {
         .flags = TCP_CONG_NON_RESTRICTED,
-        .name = "pcc",
+        .name = PCC_NAME(""),
         .owner = THIS_MODULE,
         .init = pcc_init,
-        .release        = pcc_release,
-        .cong_control = pcc_process_sample,
+        .release = pcc_release,
+        .cong_control = pcc_cong_control,
         /* Keep the windows static */
         .undo_cwnd = pcc_undo_cwnd,
         /* Slow start threshold will not exist */
@@ -632,20 +1500,214 @@ static struct tcp_congestion_ops tcp_pcc_cong_ops __read_mostly = {
 	.pkts_acked = pcc_pkts_acked,
 	.in_ack_event = pcc_ack_event,
 	.cwnd_event	= pcc_cwnd_event,
+#ifdef PCC_MIN_TSO_SEGS
+	.min_tso_segs	= pcc_tso_segs,
+#else
+	.tso_segs_goal	= pcc_tso_segs,
+#endif
+	.get_info	= pcc_get_info,
+};
+
+/* Same as pcc, but the sockets init as PCC Vivace */
+static struct tcp_congestion_ops tcp_pcc_vivace_cong_ops __read_mostly = {
+	.flags		= TCP_CONG_NON_RESTRICTED,
+	.name		= PCC_NAME("_vivace"),
+	.owner		= THIS_MODULE,
+	.init		= pcc_vivace_init,
+	.release	= pcc_release,
+	.cong_control	= pcc_cong_control,
+	.undo_cwnd	= pcc_undo_cwnd,
+	.ssthresh	= pcc_ssthresh,
+	.set_state	= pcc_set_state,
+	.cong_avoid	= pcc_cong_avoid,
+	.pkts_acked	= pcc_pkts_acked,
+	.in_ack_event	= pcc_ack_event,
+	.cwnd_event	= pcc_cwnd_event,
+#ifdef PCC_MIN_TSO_SEGS
+	.min_tso_segs	= pcc_tso_segs,
+#else
+	.tso_segs_goal	= pcc_tso_segs,
+#endif
+	.get_info	= pcc_get_info,
+};
+
+/* Same as pcc, with pcc_delay_penalty in the utility */
+static struct tcp_congestion_ops tcp_pcc_delay_cong_ops __read_mostly = {
+	.flags		= TCP_CONG_NON_RESTRICTED,
+	.name		= PCC_NAME("_delay"),
+	.owner		= THIS_MODULE,
+	.init		= pcc_delay_init,
+	.release	= pcc_release,
+	.cong_control	= pcc_cong_control,
+	.undo_cwnd	= pcc_undo_cwnd,
+	.ssthresh	= pcc_ssthresh,
+	.set_state	= pcc_set_state,
+	.cong_avoid	= pcc_cong_avoid,
+	.pkts_acked	= pcc_pkts_acked,
+	.in_ack_event	= pcc_ack_event,
+	.cwnd_event	= pcc_cwnd_event,
+#ifdef PCC_MIN_TSO_SEGS
+	.min_tso_segs	= pcc_tso_segs,
+#else
+	.tso_segs_goal	= pcc_tso_segs,
+#endif
+	.get_info	= pcc_get_info,
 };
 
 /* Kernel module section */
 
+static bool pcc_params_valid(const struct pcc_params *params)
+{
+	return params->interval_min_segs > 2 * params->ignore_packets &&
+	       params->interval_min_segs <= U16_MAX &&
+	       params->epsilon_min &&
+	       params->epsilon_min <= params->epsilon_max &&
+	       params->epsilon_max <= PCC_EPSILON_MAX &&
+	       params->alpha <= pcc_rounding_factor &&
+	       params->loss_margin <= 100 &&
+	       params->initial_rate >> PCC_RATE_SHIFT >= pcc_rate_minimum &&
+	       params->initial_rate <= pcc_initial_rate_max &&
+	       params->dst_cache_timeout <= pcc_dst_cache_timeout_max &&
+	       params->path_share <= 1;
+}
+
+/* Replaces the parameters flows read with a copy of params. Called with the
+ * module's parameters lock held, or before the ops are registered */
+static int pcc_params_publish(const struct pcc_params *params)
+{
+	struct pcc_params_rcu *live, *old;
+
+	live = kmalloc(sizeof(*live), GFP_KERNEL);
+	if (!live)
+		return -ENOMEM;
+
+	live->params = *params;
+	old = rcu_dereference_protected(pcc_params_live, true);
+	rcu_assign_pointer(pcc_params_live, live);
+	if (old)
+		kfree_rcu(old, rcu);
+	return 0;
+}
+
+/* Once the ops are unregistered, and their readers done */
+static void pcc_params_free(void)
+{
+	kfree(rcu_dereference_protected(pcc_params_live, true));
+	RCU_INIT_POINTER(pcc_params_live, NULL);
+}
+
+/* Writes are serialized by the module's parameters lock. The new value is
+ * checked on a copy, which is published as a whole, so the flows reading it
+ * never see one field of an update without the others. Before the module is
+ * loaded (insmod arguments) pcc_register() publishes them */
+static int pcc_param_set(const char *val, const struct kernel_param *kp)
+{
+	struct pcc_params params = pcc_params;
+	u32 *param = kp->arg;
+	u32 value;
+	int ret;
+
+	ret = kstrtou32(val, 0, &value);
+	if (ret)
+		return ret;
+
+	*((u32 *)&params + (param - (u32 *)&pcc_params)) = value;
+	if (!pcc_params_valid(&params))
+		return -EINVAL;
+
+	if (rcu_access_pointer(pcc_params_live)) {
+		ret = pcc_params_publish(&params);
+		if (ret)
+			return ret;
+	}
+	*param = value;
+	return 0;
+}
+
+static const struct kernel_param_ops pcc_param_ops = {
+	.set = pcc_param_set,
+	.get = param_get_uint,
+};
+
+#define pcc_module_param(name)						\
+	module_param_cb(name, &pcc_param_ops, &pcc_params.name, 0644)
+
+pcc_module_param(ignore_packets);
+MODULE_PARM_DESC(ignore_packets, "segs ignored at both ends of an interval");
+pcc_module_param(interval_min_segs);
+MODULE_PARM_DESC(interval_min_segs, "minimal segs of an interval");
+pcc_module_param(epsilon_min);
+MODULE_PARM_DESC(epsilon_min, "minimal rate probing step, in %");
+pcc_module_param(epsilon_max);
+MODULE_PARM_DESC(epsilon_max, "maximal rate probing step, in %");
+pcc_module_param(loss_margin);
+MODULE_PARM_DESC(loss_margin, "loss allowed before the utility drops, in % (0-100)");
+pcc_module_param(alpha);
+MODULE_PARM_DESC(alpha, "steepness of the utility sigmoid");
+pcc_module_param(initial_rate);
+MODULE_PARM_DESC(initial_rate, "minimal rate of new flows, in bytes/sec (up to 125000000)");
+pcc_module_param(dst_cache_timeout);
+MODULE_PARM_DESC(dst_cache_timeout,
+		 "seconds a destination's rate is kept for new flows, 0 is off");
+pcc_module_param(path_share);
+MODULE_PARM_DESC(path_share,
+		 "flows to the same destination share rate and min RTT, 0 or 1");
+
 static int __init pcc_register(void)
 {
+	int ret;
+
         BUILD_BUG_ON(sizeof(struct pcc_data) > ICSK_CA_PRIV_SIZE);
+	pcc_sigmoid_init();
+	pcc_pow2_init();
+	ret = pcc_sigmoid_selftest();
+	if (ret)
+		return ret;
+
+	/* the parameters are writable from sysfs already */
+	kernel_param_lock(THIS_MODULE);
+	ret = pcc_params_valid(&pcc_params) ?
+	      pcc_params_publish(&pcc_params) : -EINVAL;
+	kernel_param_unlock(THIS_MODULE);
+	if (ret)
+		return ret;
+
+	pcc_debugfs_dir = debugfs_create_dir(KBUILD_MODNAME, NULL);
+	debugfs_create_file("stats", 0444, pcc_debugfs_dir, NULL,
+			    &pcc_stats_fops);
+	debugfs_create_file("times", 0644, pcc_debugfs_dir, NULL,
+			    &pcc_times_fops);
+
 	printk(KERN_INFO "pcc init reg\n");
-        return tcp_register_congestion_control(&tcp_pcc_cong_ops);
+        ret = tcp_register_congestion_control(&tcp_pcc_cong_ops);
+	if (ret)
+		goto err_debugfs;
+	ret = tcp_register_congestion_control(&tcp_pcc_vivace_cong_ops);
+	if (ret)
+		goto err_pcc;
+	ret = tcp_register_congestion_control(&tcp_pcc_delay_cong_ops);
+	if (ret)
+		goto err_vivace;
+	return 0;
+
+err_vivace:
+	tcp_unregister_congestion_control(&tcp_pcc_vivace_cong_ops);
+err_pcc:
+	tcp_unregister_congestion_control(&tcp_pcc_cong_ops);
+err_debugfs:
+	debugfs_remove_recursive(pcc_debugfs_dir);
+	pcc_params_free();
+	return ret;
 }
 
 static void __exit pcc_unregister(void)
 {
+	tcp_unregister_congestion_control(&tcp_pcc_delay_cong_ops);
+	tcp_unregister_congestion_control(&tcp_pcc_vivace_cong_ops);
         tcp_unregister_congestion_control(&tcp_pcc_cong_ops);
+	debugfs_remove_recursive(pcc_debugfs_dir);
+	pcc_dst_cache_free();
+	pcc_params_free();
 }
 
 module_init(pcc_register);
@@ -0,0 +1,471 @@
+/* The kernel tcp_pcc.c is built against, for userspace (see pcc_replay.c).
+ * Every kernel header it includes comes here. Only what it uses is stubbed,
+ * for a single socket context on a single cpu: the per cpu data is plain,
+ * locking and RCU are no-ops, and the module hooks are left to the caller.
+ */
+#ifndef _PCC_KERNEL_STUBS_H
+#define _PCC_KERNEL_STUBS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "../kernel.h"
+
+typedef int8_t s8;
+typedef int16_t s16;
+typedef uint8_t __u8;
+typedef uint16_t __u16;
+typedef uint32_t __u32;
+typedef uint64_t __u64;
+typedef int32_t __s32;
+typedef unsigned short umode_t;
+
+#define KERNEL_VERSION(a, b, c) (((a) << 16) + ((b) << 8) + (c))
+#define LINUX_VERSION_CODE KERNEL_VERSION(4, 15, 0)
+
+#define S64_MAX INT64_MAX
+#define U16_MAX UINT16_MAX
+#define U64_MAX UINT64_MAX
+#define USEC_PER_MSEC 1000UL
+#define NSEC_PER_USEC 1000UL
+#define HZ 1000
+
+#define __exit
+#define __user
+#define __rcu
+#define __force
+#define ____cacheline_aligned_in_smp __attribute__((aligned(64)))
+#define likely(x) __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+#define IS_ENABLED(option) 1
+
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define clamp(val, lo, hi) min(max(val, lo), hi)
+#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
+#define DIV_ROUND_UP_ULL(n, d) DIV_ROUND_UP((u64)(n), (d))
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define BUILD_BUG_ON(cond) _Static_assert(!(cond), #cond)
+#define READ_ONCE(x) (x)
+#define WRITE_ONCE(x, val) ((x) = (val))
+#define cmpxchg(ptr, old, new) __sync_val_compare_and_swap(ptr, old, new)
+#define xchg(ptr, val) __atomic_exchange_n(ptr, val, __ATOMIC_SEQ_CST)
+#define __stringify_1(x) #x
+#define __stringify(x) __stringify_1(x)
+
+static inline s64 div_s64(s64 dividend, s32 divisor)
+{
+	return dividend / divisor;
+}
+
+static inline int ilog2(u64 n)
+{
+	return fls64(n) - 1;
+}
+
+#define KERN_INFO ""
+#define KERN_ERR ""
+#define printk(fmt, ...) fprintf(stderr, fmt, ##__VA_ARGS__)
+
+/* module */
+#define KBUILD_MODNAME "tcp_pcc"
+#define THIS_MODULE NULL
+#define module_init(fn) \
+	static int (*__module_init)(void) __attribute__((unused)) = fn
+#define module_exit(fn) \
+	static void (*__module_exit)(void) __attribute__((unused)) = fn
+#define MODULE_AUTHOR(author)
+#define MODULE_LICENSE(license)
+#define MODULE_DESCRIPTION(desc)
+#define MODULE_PARM_DESC(name, desc)
+#define kernel_param_lock(mod)
+#define kernel_param_unlock(mod)
+
+struct kernel_param_ops;
+
+struct kernel_param {
+	const char *name;
+	const struct kernel_param_ops *ops;
+	void *arg;
+};
+
+struct kernel_param_ops {
+	int (*set)(const char *val, const struct kernel_param *kp);
+	int (*get)(char *buffer, const struct kernel_param *kp);
+};
+
+/* In the __param section as in the kernel, the linker bounds it with
+ * __start___param and __stop___param */
+#define module_param_cb(name, ops, argp, perm)				\
+	static const struct kernel_param __param_##name			\
+		__attribute__((used, section("__param"), aligned(8))) =	\
+		{ #name, ops, argp }
+
+static inline int param_get_uint(char *buffer, const struct kernel_param *kp)
+{
+	return sprintf(buffer, "%u\n", *(u32 *)kp->arg);
+}
+
+static inline int kstrtou32(const char *s, unsigned int base, u32 *res)
+{
+	char *end;
+
+	errno = 0;
+	*res = strtoul(s, &end, base);
+	return errno || end == s ? -EINVAL : 0;
+}
+
+static inline int kstrtobool_from_user(const char __user *s, size_t count,
+				       bool *res)
+{
+	*res = count && (s[0] == '1' || s[0] == 'y' || s[0] == 'Y');
+	return 0;
+}
+
+/* memory, RCU, atomics */
+#define GFP_KERNEL 0
+#define GFP_ATOMIC 1
+#define kmalloc(size, flags) malloc(size)
+#define kfree(ptr) free((void *)(ptr))
+#define kfree_rcu(ptr, field) kfree(ptr)
+
+struct rcu_head {
+	void *next;
+};
+
+#define rcu_read_lock()
+#define rcu_read_unlock()
+#define rcu_dereference(p) (p)
+#define rcu_dereference_protected(p, c) (p)
+#define rcu_access_pointer(p) (p)
+#define rcu_assign_pointer(p, v) ((p) = (v))
+#define RCU_INIT_POINTER(p, v) ((p) = (v))
+
+typedef struct {
+	int counter;
+} atomic_t;
+
+static inline int atomic_inc_return(atomic_t *v)
+{
+	return ++v->counter;
+}
+
+static inline bool atomic_dec_and_test(atomic_t *v)
+{
+	return !--v->counter;
+}
+
+/* per cpu data, on a single cpu */
+#define DEFINE_PER_CPU(type, name) type name
+#define this_cpu_read(var) (var)
+#define this_cpu_write(var, val) ((var) = (val))
+#define this_cpu_inc(var) ((var)++)
+#define per_cpu_ptr(ptr, cpu) (ptr)
+#define for_each_possible_cpu(cpu) for ((cpu) = 0; (cpu) < 1; (cpu)++)
+
+/* static keys are plain flags */
+struct static_key_false {
+	bool enabled;
+};
+
+#define DEFINE_STATIC_KEY_FALSE(name) struct static_key_false name
+#define static_branch_unlikely(key) unlikely((key)->enabled)
+#define static_key_enabled(key) ((key)->enabled)
+#define static_branch_enable(key) ((key)->enabled = true)
+#define static_branch_disable(key) ((key)->enabled = false)
+
+static inline u64 local_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static unsigned long jiffies;
+#define time_before(a, b) ((long)((a) - (b)) < 0)
+
+/* a fixed sequence, so runs repeat */
+static inline u32 prandom_u32(void)
+{
+	static u32 state = 2463534242U;
+
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+/* debugfs and seq_file: the show functions print to stdout */
+struct inode;
+struct dentry;
+
+struct file {
+	void *private_data;
+};
+
+struct seq_file {
+	FILE *out;
+};
+
+struct file_operations {
+	void *owner;
+	int (*open)(struct inode *inode, struct file *file);
+	ssize_t (*read)(struct file *file, char __user *buf, size_t size,
+			loff_t *ppos);
+	ssize_t (*write)(struct file *file, const char __user *buf,
+			 size_t count, loff_t *ppos);
+	loff_t (*llseek)(struct file *file, loff_t offset, int whence);
+	int (*release)(struct inode *inode, struct file *file);
+};
+
+#define seq_printf(seq, fmt, ...) fprintf((seq)->out, fmt, ##__VA_ARGS__)
+#define seq_putc(seq, c) fputc(c, (seq)->out)
+
+static inline int single_open(struct file *file,
+			      int (*show)(struct seq_file *, void *),
+			      void *data)
+{
+	return 0;
+}
+
+static inline int single_release(struct inode *inode, struct file *file)
+{
+	return 0;
+}
+
+static inline ssize_t seq_read(struct file *file, char __user *buf,
+			       size_t size, loff_t *ppos)
+{
+	return 0;
+}
+
+static inline loff_t seq_lseek(struct file *file, loff_t offset, int whence)
+{
+	return 0;
+}
+
+static inline struct dentry *debugfs_create_dir(const char *name,
+						struct dentry *parent)
+{
+	return NULL;
+}
+
+static inline struct dentry *
+debugfs_create_file(const char *name, umode_t mode, struct dentry *parent,
+		    void *data, const struct file_operations *fops)
+{
+	return NULL;
+}
+
+static inline void debugfs_remove_recursive(struct dentry *dentry)
+{
+}
+
+/* net */
+#define AF_INET 2
+#define AF_INET6 10
+
+struct in6_addr {
+	u32 s6_addr32[4];
+};
+
+struct net;
+
+static inline u32 net_hash_mix(const struct net *net)
+{
+	return 0;
+}
+
+static inline void ipv6_addr_set_v4mapped(u32 addr, struct in6_addr *v4mapped)
+{
+	v4mapped->s6_addr32[0] = 0;
+	v4mapped->s6_addr32[1] = 0;
+	v4mapped->s6_addr32[2] = 0xffff0000;	/* as big endian 0x0000ffff */
+	v4mapped->s6_addr32[3] = addr;
+}
+
+static inline u32 ipv6_addr_hash(const struct in6_addr *a)
+{
+	return a->s6_addr32[0] ^ a->s6_addr32[1] ^ a->s6_addr32[2] ^
+	       a->s6_addr32[3];
+}
+
+static inline bool ipv6_addr_equal(const struct in6_addr *a1,
+				   const struct in6_addr *a2)
+{
+	return !memcmp(a1, a2, sizeof(*a1));
+}
+
+#define GOLDEN_RATIO_32 0x61C88647
+
+static inline u32 hash_32(u32 val, unsigned int bits)
+{
+	return val * GOLDEN_RATIO_32 >> (32 - bits);
+}
+
+/* tcp: the fields tcp_pcc.c reads and writes, the caller keeps them as the
+ * stack would */
+#define MAX_TCP_HEADER 320
+#define TCP_INFINITE_SSTHRESH 0x7fffffff
+#define TCP_CONG_NON_RESTRICTED 0x1
+#define ICSK_CA_PRIV_SIZE 88
+#define INET_DIAG_INFO 2
+
+enum {
+	TCP_CA_Open,
+	TCP_CA_Disorder,
+	TCP_CA_CWR,
+	TCP_CA_Recovery,
+	TCP_CA_Loss,
+};
+
+enum tcp_ca_event {
+	CA_EVENT_TX_START,
+	CA_EVENT_CWND_RESTART,
+	CA_EVENT_COMPLETE_CWR,
+	CA_EVENT_LOSS,
+	CA_EVENT_ECN_NO_CE,
+	CA_EVENT_ECN_IS_CE,
+};
+
+enum sk_pacing {
+	SK_PACING_NONE,
+	SK_PACING_NEEDED,
+	SK_PACING_FQ,
+};
+
+struct sock {
+	unsigned short sk_family;
+	u32 sk_daddr;
+	struct in6_addr sk_v6_daddr;
+	struct net *sk_net;
+	unsigned long sk_pacing_rate;		/* bytes/sec */
+	unsigned long sk_max_pacing_rate;
+	u8 sk_pacing_shift;
+	u32 sk_pacing_status;
+	unsigned int sk_gso_max_size;
+};
+
+static inline struct net *sock_net(const struct sock *sk)
+{
+	return sk->sk_net;
+}
+
+struct inet_connection_sock {
+	struct sock icsk_inet;
+	u8 icsk_ca_state;
+	u64 icsk_ca_priv[ICSK_CA_PRIV_SIZE / sizeof(u64)];
+};
+
+struct tcp_sock {
+	struct inet_connection_sock inet_conn;
+	u64 tcp_mstamp;		/* usec, of the ack being processed */
+	u32 srtt_us;		/* smoothed RTT << 3, in usec */
+	u32 mdev_us;		/* mean deviation << 2 */
+	u32 rtt_min;		/* of the whole flow, not windowed */
+	u32 mss_cache;
+	u32 snd_cwnd;
+	u32 snd_cwnd_clamp;
+	u32 snd_ssthresh;
+	u32 delivered;
+	u32 lost;
+};
+
+static inline struct tcp_sock *tcp_sk(const struct sock *sk)
+{
+	return (struct tcp_sock *)sk;
+}
+
+static inline struct inet_connection_sock *inet_csk(const struct sock *sk)
+{
+	return (struct inet_connection_sock *)sk;
+}
+
+static inline void *inet_csk_ca(const struct sock *sk)
+{
+	return ((struct inet_connection_sock *)sk)->icsk_ca_priv;
+}
+
+static inline u32 tcp_min_rtt(const struct tcp_sock *tp)
+{
+	return tp->rtt_min;
+}
+
+static inline bool before(u32 seq1, u32 seq2)
+{
+	return (s32)(seq1 - seq2) < 0;
+}
+#define after(seq2, seq1) before(seq1, seq2)
+
+struct rate_sample {
+	u64 prior_mstamp;	/* usec, when the packet's delivered was taken */
+	u32 prior_delivered;
+	s32 delivered;
+	long interval_us;
+	long rtt_us;		/* -1 without a sample */
+	int losses;
+	u32 acked_sacked;
+	u32 prior_in_flight;
+	bool is_app_limited;
+	bool is_retrans;
+	bool is_ack_delayed;
+};
+
+struct ack_sample {
+	u32 pkts_acked;
+	s32 rtt_us;
+	u32 in_flight;
+};
+
+union tcp_cc_info {
+	u32 raw[5];		/* the size of struct tcp_bbr_info */
+};
+
+struct tcp_congestion_ops {
+	void (*init)(struct sock *sk);
+	void (*release)(struct sock *sk);
+	u32 (*ssthresh)(struct sock *sk);
+	void (*cong_avoid)(struct sock *sk, u32 ack, u32 acked);
+	void (*set_state)(struct sock *sk, u8 new_state);
+	void (*cwnd_event)(struct sock *sk, enum tcp_ca_event ev);
+	void (*in_ack_event)(struct sock *sk, u32 flags);
+	u32 (*undo_cwnd)(struct sock *sk);
+	void (*pkts_acked)(struct sock *sk, const struct ack_sample *sample);
+	u32 (*tso_segs_goal)(struct sock *sk);
+	u32 (*min_tso_segs)(struct sock *sk);
+	void (*cong_control)(struct sock *sk, const struct rate_sample *rs);
+	size_t (*get_info)(struct sock *sk, u32 ext, int *attr,
+			   union tcp_cc_info *info);
+	char name[16];
+	void *owner;
+	u32 flags;
+	struct tcp_congestion_ops *next;
+};
+
+/* registered ops, newest first */
+static struct tcp_congestion_ops *tcp_cong_list;
+
+static inline int tcp_register_congestion_control(struct tcp_congestion_ops *ca)
+{
+	ca->next = tcp_cong_list;
+	tcp_cong_list = ca;
+	return 0;
+}
+
+static inline void
+tcp_unregister_congestion_control(struct tcp_congestion_ops *ca)
+{
+	struct tcp_congestion_ops **pos;
+
+	for (pos = &tcp_cong_list; *pos; pos = &(*pos)->next)
+		if (*pos == ca) {
+			*pos = ca->next;
+			return;
+		}
+}
+
+#endif /* _PCC_KERNEL_STUBS_H */
@@ -0,0 +1,686 @@
+/* PCC's ACK path, in userspace.
+ * src/tcp_pcc.c is built as it is against the stubs of include/, and its
+ * registered cong_control hook gets the ACKs the way the stack would hand
+ * them: tcp_sock and the rate sample hold what tcp_input.c and tcp_rate.c
+ * would have set. The ACKs come from a synthetic link, or from a trace.
+ *
+ * The link is a bottleneck of fixed bandwidth behind a drop tail buffer, with
+ * random loss before it and the base RTT after it. Its flows always have data,
+ * pace at sk_pacing_rate and keep within snd_cwnd. Every packet is acked,
+ * there is no reordering, so a dropped packet is marked lost by the ACK of the
+ * next one that made it. There are no retransmissions and no timeouts.
+ *
+ * A trace has a line per ACK, with what the hook read of it (replay_write):
+ * -o writes the ACKs of the first flow of a link, -r replays them through the
+ * hook as fast as it goes. The cwnd and the rate the hook sets do not change
+ * a replay, so it is for timing and for regressions, not for convergence.
+ *
+ * The hook's cost is reported in ns per ACK: with the clock reads around each
+ * call on the link, over the whole replay otherwise. Its decisions are counted
+ * by the tracepoints, defined here instead of by pcc_trace.h, per second of
+ * link time or of replay time. On the link, -u and -F fail the run below
+ * a utilization and a fairness (Jain's index) over its second half, -l above
+ * a loss over all of it.
+ */
+#include <unistd.h>
+#include <net/tcp.h>
+
+#define REPLAY_MSS 1448
+#define REPLAY_FLOWS_MAX 16
+#define REPLAY_PARAMS_MAX 16
+#define REPLAY_WRAP (1U << 16)	/* packets before the counters wrap, -w */
+#define NSEC_PER_SEC 1000000000ULL
+
+static struct {
+	u64 intervals;
+	u64 decisions;
+	u64 modes;
+} replay_counts;
+
+static bool replay_verbose;
+static bool replay_one_dst;
+
+/* tcp_pcc.c's tracepoints, in place of pcc_trace.h's */
+#define _PCC_TRACE_H
+
+static void trace_pcc_interval(const struct sock *sk, u64 rate, u64 goodput,
+			       u32 delivered, u32 lost, s64 utility,
+			       u32 rtt_min, u32 rtt_mean, s32 rtt_gradient)
+{
+	replay_counts.intervals++;
+}
+
+static void trace_pcc_decision(const struct sock *sk, int mode, u64 rate,
+			       u64 new_rate, s64 utility, u32 epsilon,
+			       int intervals_count, u32 rtt)
+{
+	u64 now = tcp_sk(sk)->tcp_mstamp;
+
+	replay_counts.decisions++;
+	if (replay_verbose)
+		printf("%p %llu.%06llu: mode %d rate %llu -> %llu utility %lld epsilon %u rtt %u\n",
+		       (void *)sk, (unsigned long long)(now / USEC_PER_SEC),
+		       (unsigned long long)(now % USEC_PER_SEC), mode,
+		       (unsigned long long)rate, (unsigned long long)new_rate,
+		       (long long)utility, epsilon, rtt);
+}
+
+static void trace_pcc_mode(const struct sock *sk, int old_mode, int new_mode)
+{
+	replay_counts.modes++;
+}
+
+#include "tcp_pcc.c"
+
+extern const struct kernel_param __start___param[], __stop___param[];
+
+/* A packet on the link, kept by the bottleneck's ACKs or by its flow's drops */
+struct packet {
+	u64 seq;
+	u64 sent_ns;
+	u64 exit_ns;		/* from the bottleneck, acked an RTT later */
+	u64 first_tx_mstamp;	/* usec, as tcp_rate.c keeps them */
+	u64 delivered_mstamp;
+	u32 delivered;
+	u32 flow;
+};
+
+struct packet_fifo {
+	struct packet *packets;
+	u32 head;
+	u32 count;
+	u32 size;		/* a power of 2 */
+};
+
+struct flow {
+	struct tcp_sock tp;
+	struct packet_fifo dropped;
+	u64 next_seq;
+	u64 next_send_ns;
+	u32 packets_out;
+	u64 first_tx_mstamp;
+	u64 delivered_mstamp;
+
+	u64 acked;		/* over the measured half of the run */
+	u64 sent;
+	u64 lost;
+	u64 hook_ns;		/* over all of it */
+	u64 acks;
+};
+
+struct link {
+	u64 bandwidth;		/* bytes/sec */
+	u64 buffer;		/* bytes */
+	u32 loss;		/* in 1/2^32 */
+	u64 rtt_ns;
+	u64 tx_ns;		/* of a packet */
+	u64 free_ns;		/* when the bottleneck sent what it has */
+	struct packet_fifo acks;
+	u64 random;
+
+	u64 queue_ns;		/* over the measured half of the run */
+	u64 queued;
+};
+
+/* An ACK of a trace, as the hook read it */
+struct replay_ack {
+	u64 tcp_mstamp;
+	u32 delivered;
+	u32 lost;
+	u32 srtt_us;
+	u32 mdev_us;
+	u32 rtt_min;
+	struct rate_sample rs;
+};
+
+static void fifo_push(struct packet_fifo *fifo, const struct packet *packet)
+{
+	if (fifo->count == fifo->size) {
+		u32 size = fifo->size ? fifo->size * 2 : 1024;
+		struct packet *packets = malloc(size * sizeof(*packets));
+		u32 i;
+
+		if (!packets) {
+			perror("malloc");
+			exit(1);
+		}
+		for (i = 0; i < fifo->count; i++)
+			packets[i] = fifo->packets[(fifo->head + i) &
+						   (fifo->size - 1)];
+		free(fifo->packets);
+		fifo->packets = packets;
+		fifo->head = 0;
+		fifo->size = size;
+	}
+	fifo->packets[(fifo->head + fifo->count++) & (fifo->size - 1)] =
+		*packet;
+}
+
+static struct packet *fifo_peek(struct packet_fifo *fifo)
+{
+	return fifo->count ? &fifo->packets[fifo->head] : NULL;
+}
+
+static void fifo_pop(struct packet_fifo *fifo)
+{
+	fifo->head = (fifo->head + 1) & (fifo->size - 1);
+	fifo->count--;
+}
+
+static u32 link_random(struct link *link)
+{
+	link->random ^= link->random << 13;
+	link->random ^= link->random >> 7;
+	link->random ^= link->random << 17;
+	return link->random >> 32;
+}
+
+static const struct tcp_congestion_ops *replay_ops(const char *name)
+{
+	const struct tcp_congestion_ops *ops;
+
+	for (ops = tcp_cong_list; ops; ops = ops->next)
+		if (!strcmp(ops->name, name))
+			return ops;
+	fprintf(stderr, "no congestion control %s\n", name);
+	exit(1);
+}
+
+static void replay_param(const char *arg)
+{
+	const struct kernel_param *kp;
+	const char *value = strchr(arg, '=');
+
+	for (kp = __start___param; value && kp < __stop___param; kp++) {
+		if (strlen(kp->name) != value - arg ||
+		    strncmp(kp->name, arg, value - arg))
+			continue;
+		if (kp->ops->set(value + 1, kp)) {
+			fprintf(stderr, "invalid %s\n", arg);
+			exit(1);
+		}
+		return;
+	}
+	fprintf(stderr, "no parameter %s\n", arg);
+	exit(1);
+}
+
+/* A connected socket, its RTT sampled by the handshake */
+static void flow_init(struct flow *flow, int index,
+		      const struct tcp_congestion_ops *ops, u32 rtt_us,
+		      u32 counters)
+{
+	struct tcp_sock *tp = &flow->tp;
+	struct sock *sk = (struct sock *)tp;
+
+	free(flow->dropped.packets);
+	memset(flow, 0, sizeof(*flow));
+	sk->sk_family = AF_INET;
+	sk->sk_daddr = 0x0a000001 + (replay_one_dst ? 0 : index);
+	sk->sk_max_pacing_rate = ~0UL;
+	sk->sk_pacing_shift = 10;
+	sk->sk_gso_max_size = 65536;
+	tp->mss_cache = REPLAY_MSS;
+	tp->snd_cwnd = 10;
+	tp->snd_cwnd_clamp = ~0U;
+	tp->snd_ssthresh = TCP_INFINITE_SSTHRESH;
+	tp->delivered = counters;
+	tp->lost = counters;
+	tp->srtt_us = rtt_us << 3;
+	tp->mdev_us = rtt_us << 1;
+	tp->rtt_min = rtt_us;
+	ops->init(sk);
+}
+
+/* tcp_rtt_estimator() */
+static void flow_rtt_sample(struct tcp_sock *tp, long rtt_us)
+{
+	long m = rtt_us - (tp->srtt_us >> 3);
+
+	tp->srtt_us = max_t(long, tp->srtt_us + m, 1);
+	if (m < 0) {
+		m = -m - (tp->mdev_us >> 2);
+		if (m > 0)
+			m >>= 3;
+	} else {
+		m -= tp->mdev_us >> 2;
+	}
+	tp->mdev_us += m;
+	tp->rtt_min = min_t(u32, tp->rtt_min, rtt_us);
+}
+
+static void replay_write(FILE *out, const struct tcp_sock *tp,
+			 const struct rate_sample *rs)
+{
+	fprintf(out, "%llu %u %u %u %u %u %llu %u %d %ld %ld %d %u %d\n",
+		(unsigned long long)tp->tcp_mstamp, tp->delivered, tp->lost,
+		tp->srtt_us, tp->mdev_us, tp->rtt_min,
+		(unsigned long long)rs->prior_mstamp, rs->prior_delivered,
+		rs->delivered, rs->interval_us, rs->rtt_us, rs->losses,
+		rs->acked_sacked, rs->is_app_limited);
+}
+
+static bool replay_read(FILE *in, struct replay_ack *ack)
+{
+	unsigned long long tcp_mstamp, prior_mstamp;
+	int app_limited;
+
+	memset(ack, 0, sizeof(*ack));
+	if (fscanf(in, "%llu %u %u %u %u %u %llu %u %d %ld %ld %d %u %d",
+		   &tcp_mstamp, &ack->delivered, &ack->lost, &ack->srtt_us,
+		   &ack->mdev_us, &ack->rtt_min, &prior_mstamp,
+		   &ack->rs.prior_delivered, &ack->rs.delivered,
+		   &ack->rs.interval_us, &ack->rs.rtt_us, &ack->rs.losses,
+		   &ack->rs.acked_sacked, &app_limited) != 14)
+		return false;
+	ack->tcp_mstamp = tcp_mstamp;
+	ack->rs.prior_mstamp = prior_mstamp;
+	ack->rs.is_app_limited = app_limited;
+	return true;
+}
+
+/* The stack's usec clock, which is never 0 where the link's starts */
+static u64 link_mstamp(u64 ns)
+{
+	return USEC_PER_SEC + ns / NSEC_PER_USEC;
+}
+
+static void link_send(struct link *link, struct flow *flow, u32 index,
+		      u64 now, bool measured)
+{
+	struct tcp_sock *tp = &flow->tp;
+	u64 now_us = link_mstamp(now);
+	u64 backlog = 0;
+	struct packet packet;
+
+	if (!flow->packets_out) {
+		flow->first_tx_mstamp = now_us;
+		flow->delivered_mstamp = now_us;
+	}
+	packet.seq = flow->next_seq++;
+	packet.sent_ns = now;
+	packet.first_tx_mstamp = flow->first_tx_mstamp;
+	packet.delivered_mstamp = flow->delivered_mstamp;
+	packet.delivered = tp->delivered;
+	packet.flow = index;
+	flow->packets_out++;
+	flow->sent += measured;
+
+	if (link->free_ns > now)
+		backlog = (link->free_ns - now) * link->bandwidth /
+			  NSEC_PER_SEC;
+	if (link_random(link) < link->loss ||
+	    backlog + REPLAY_MSS > link->buffer) {
+		fifo_push(&flow->dropped, &packet);
+		flow->lost += measured;
+		return;
+	}
+	link->free_ns = max(link->free_ns, now) + link->tx_ns;
+	packet.exit_ns = link->free_ns;
+	fifo_push(&link->acks, &packet);
+}
+
+/* What tcp_ack() does with it, up to tcp_cong_control() */
+static void link_ack(struct link *link, struct flow *flow,
+		     const struct tcp_congestion_ops *ops,
+		     const struct packet *packet, u64 now, bool measured,
+		     FILE *out)
+{
+	struct tcp_sock *tp = &flow->tp;
+	struct rate_sample rs = {};
+	u64 now_us = link_mstamp(now);
+	u64 sent_us = link_mstamp(packet->sent_ns);
+	struct packet *dropped;
+	u64 start;
+
+	while ((dropped = fifo_peek(&flow->dropped)) &&
+	       dropped->seq < packet->seq) {
+		fifo_pop(&flow->dropped);
+		rs.losses++;
+	}
+	rs.prior_in_flight = flow->packets_out;
+	flow->packets_out -= rs.losses + 1;
+	tp->lost += rs.losses;
+	tp->delivered++;
+	tp->tcp_mstamp = now_us;
+	rs.rtt_us = now_us - sent_us;
+	flow_rtt_sample(tp, rs.rtt_us);
+
+	rs.prior_delivered = packet->delivered;
+	rs.prior_mstamp = packet->delivered_mstamp;
+	rs.delivered = tp->delivered - packet->delivered;
+	rs.interval_us = max(sent_us - packet->first_tx_mstamp,
+			     now_us - packet->delivered_mstamp);
+	rs.acked_sacked = 1;
+	flow->first_tx_mstamp = sent_us;
+	flow->delivered_mstamp = now_us;
+
+	if (out)
+		replay_write(out, tp, &rs);
+	start = local_clock();
+	ops->cong_control((struct sock *)tp, &rs);
+	flow->hook_ns += local_clock() - start;
+	flow->acks++;
+
+	if (measured) {
+		flow->acked++;
+		link->queue_ns += packet->exit_ns - link->tx_ns -
+				  packet->sent_ns;
+		link->queued++;
+	}
+	flow->next_send_ns = max(flow->next_send_ns, now);
+}
+
+static void link_run(struct link *link, struct flow *flows, u32 count,
+		     const struct tcp_congestion_ops *ops, u64 duration_ns,
+		     FILE *out)
+{
+	for (;;) {
+		struct packet *ack = fifo_peek(&link->acks);
+		u64 now = ack ? ack->exit_ns + link->rtt_ns : U64_MAX;
+		struct flow *sender = NULL;
+		u32 i, index = 0;
+
+		for (i = 0; i < count; i++) {
+			struct flow *flow = &flows[i];
+
+			if (flow->next_send_ns < now &&
+			    flow->packets_out < tcp_snd_cwnd(&flow->tp)) {
+				now = flow->next_send_ns;
+				sender = flow;
+				index = i;
+			}
+		}
+		if (now >= duration_ns)
+			break;
+
+		if (sender) {
+			u64 rate = sender->tp.inet_conn.icsk_inet.sk_pacing_rate;
+
+			link_send(link, sender, index, now,
+				  now >= duration_ns / 2);
+			if (rate)
+				sender->next_send_ns = now + REPLAY_MSS *
+						       NSEC_PER_SEC / rate;
+		} else {
+			struct packet packet = *ack;
+
+			fifo_pop(&link->acks);
+			link_ack(link, &flows[packet.flow], ops, &packet, now,
+				 now >= duration_ns / 2,
+				 packet.flow ? NULL : out);
+		}
+	}
+}
+
+static void replay_stats(void)
+{
+	struct seq_file seq = { .out = stdout };
+
+	pcc_stats_show(&seq, NULL);
+	pcc_times_show(&seq, NULL);
+}
+
+static int link_main(struct link *link, u32 count,
+		     const struct tcp_congestion_ops *ops, u32 seconds,
+		     u32 counters, const char *path, double min_utilization,
+		     double min_fairness, double max_loss)
+{
+	static struct flow flows[REPLAY_FLOWS_MAX];
+	u64 duration_ns = seconds * NSEC_PER_SEC;
+	double acked = 0, squares = 0, sent = 0, lost = 0;
+	double utilization, fairness, loss, hook_ns = 0, acks = 0;
+	FILE *out = NULL;
+	u32 i;
+
+	if (path) {
+		out = fopen(path, "w");
+		if (!out) {
+			perror(path);
+			return 1;
+		}
+	}
+	for (i = 0; i < count; i++)
+		flow_init(&flows[i], i, ops, link->rtt_ns / NSEC_PER_USEC,
+			  counters);
+	link_run(link, flows, count, ops, duration_ns, out);
+	for (i = 0; i < count; i++) {
+		ops->release((struct sock *)&flows[i].tp);
+		acked += flows[i].acked;
+		squares += (double)flows[i].acked * flows[i].acked;
+		sent += flows[i].sent;
+		lost += flows[i].lost;
+		hook_ns += flows[i].hook_ns;
+		acks += flows[i].acks;
+	}
+	if (out)
+		fclose(out);
+
+	utilization = acked * REPLAY_MSS /
+		      (link->bandwidth * (duration_ns / 2) / 1e9);
+	fairness = squares ? acked * acked / (count * squares) : 0;
+	loss = sent ? lost / sent : 0;
+	printf("# utilization queue_delay_ms loss fairness ns/ack decisions/sec\n");
+	printf("%.4f %.2f %.4f %.4f %.1f %.1f\n", utilization,
+	       link->queued ? link->queue_ns / 1e6 / link->queued : 0,
+	       loss, fairness, acks ? hook_ns / acks : 0,
+	       replay_counts.decisions / (duration_ns / 1e9));
+
+	if (utilization < min_utilization) {
+		fprintf(stderr, "utilization %.4f below %.4f\n", utilization,
+			min_utilization);
+		return 1;
+	}
+	if (fairness < min_fairness) {
+		fprintf(stderr, "fairness %.4f below %.4f\n", fairness,
+			min_fairness);
+		return 1;
+	}
+	if (loss > max_loss) {
+		fprintf(stderr, "loss %.4f above %.4f\n", loss, max_loss);
+		return 1;
+	}
+	return 0;
+}
+
+static int replay_main(const char *path, const struct tcp_congestion_ops *ops,
+		       u32 repeats)
+{
+	static struct flow flow;
+	struct tcp_sock *tp = &flow.tp;
+	struct replay_ack *acks = NULL;
+	size_t count = 0, size = 0, i;
+	u64 start, elapsed;
+	FILE *in;
+	u32 n;
+
+	in = fopen(path, "r");
+	if (!in) {
+		perror(path);
+		return 1;
+	}
+	for (;;) {
+		if (count == size) {
+			size = size ? size * 2 : 4096;
+			acks = realloc(acks, size * sizeof(*acks));
+			if (!acks) {
+				perror("realloc");
+				return 1;
+			}
+		}
+		if (!replay_read(in, &acks[count]))
+			break;
+		count++;
+	}
+	fclose(in);
+	if (!count) {
+		fprintf(stderr, "%s: no acks\n", path);
+		return 1;
+	}
+
+	start = local_clock();
+	for (n = 0; n < repeats; n++) {
+		flow_init(&flow, 0, ops, acks[0].srtt_us >> 3,
+			  acks[0].delivered);
+		for (i = 0; i < count; i++) {
+			const struct replay_ack *ack = &acks[i];
+
+			tp->tcp_mstamp = ack->tcp_mstamp;
+			tp->delivered = ack->delivered;
+			tp->lost = ack->lost;
+			tp->srtt_us = ack->srtt_us;
+			tp->mdev_us = ack->mdev_us;
+			tp->rtt_min = ack->rtt_min;
+			ops->cong_control((struct sock *)tp, &ack->rs);
+		}
+		ops->release((struct sock *)tp);
+	}
+	elapsed = local_clock() - start;
+
+	printf("# acks ns/ack decisions decisions/sec\n");
+	printf("%zu %.1f %llu %.0f\n", count,
+	       (double)elapsed / (count * repeats),
+	       (unsigned long long)replay_counts.decisions,
+	       replay_counts.decisions * 1e9 / elapsed);
+	free(acks);
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-c name] [-p param=value] [-f flows] [-t seconds] [-B mbps]\n"
+		"          [-R rtt_ms] [-Q buffer_kb] [-L loss_%%] [-S seed] [-w] [-o trace]\n"
+		"          [-u utilization] [-F fairness] [-l loss] [-D] [-s] [-V]\n"
+		"       %s [-c name] [-p param=value] [-n repeats] [-s] [-V] -r trace\n"
+		"  -c  the congestion control, pcc by default\n"
+		"  -p  sets a module parameter, as /sys/module/tcp_pcc/parameters/ would\n"
+		"  -f  flows sharing the link, 1 by default\n"
+		"  -t  seconds of link time, 20 by default\n"
+		"  -B  the bottleneck's bandwidth, 100 Mbit/s by default\n"
+		"  -R  the base RTT, 30 ms by default\n"
+		"  -Q  the bottleneck's buffer, a BDP by default\n"
+		"  -L  random loss before the bottleneck\n"
+		"  -S  seeds the random loss\n"
+		"  -D  sends all flows to one destination, as one path with path_share\n"
+		"  -w  starts the delivered and lost counters %u packets before they wrap\n"
+		"  -o  writes the ACKs of the first flow as a trace\n"
+		"  -u  fails below this utilization of the second half of the run\n"
+		"  -F  fails below this fairness of the second half of the run\n"
+		"  -l  fails above this loss of the run\n"
+		"  -r  replays the ACKs of a trace through one socket\n"
+		"  -n  times the trace is replayed, 1 by default\n"
+		"  -s  prints the module's stats and times, with the times enabled\n"
+		"  -V  prints the decisions\n",
+		prog, prog, REPLAY_WRAP);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *name = "pcc", *replay = NULL, *out = NULL;
+	const char *params[REPLAY_PARAMS_MAX];
+	double mbps = 100, rtt_ms = 30, loss = 0, buffer_kb = 0;
+	double min_utilization = 0, min_fairness = 0, max_loss = 1;
+	u32 flows = 1, seconds = 20, repeats = 1, counters = 0;
+	u32 param_count = 0, i;
+	const struct tcp_congestion_ops *ops;
+	struct link link = { .random = 88172645463325252ULL };
+	bool stats = false;
+	int opt, ret;
+
+	while ((opt = getopt(argc, argv, "c:p:f:t:B:R:Q:L:S:Dwo:u:F:l:r:n:sV")) != -1) {
+		switch (opt) {
+		case 'c':
+			name = optarg;
+			break;
+		case 'p':
+			if (param_count == REPLAY_PARAMS_MAX)
+				usage(argv[0]);
+			params[param_count++] = optarg;
+			break;
+		case 'f':
+			flows = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'B':
+			mbps = atof(optarg);
+			break;
+		case 'R':
+			rtt_ms = atof(optarg);
+			break;
+		case 'Q':
+			buffer_kb = atof(optarg);
+			break;
+		case 'L':
+			loss = atof(optarg);
+			break;
+		case 'S':
+			link.random = strtoull(optarg, NULL, 0);
+			break;
+		case 'D':
+			replay_one_dst = true;
+			break;
+		case 'w':
+			counters = 0U - REPLAY_WRAP;
+			break;
+		case 'o':
+			out = optarg;
+			break;
+		case 'u':
+			min_utilization = atof(optarg);
+			break;
+		case 'F':
+			min_fairness = atof(optarg);
+			break;
+		case 'l':
+			max_loss = atof(optarg);
+			break;
+		case 'r':
+			replay = optarg;
+			break;
+		case 'n':
+			repeats = atoi(optarg);
+			break;
+		case 's':
+			stats = true;
+			break;
+		case 'V':
+			replay_verbose = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc || !flows || flows > REPLAY_FLOWS_MAX || !seconds ||
+	    !repeats || !link.random || mbps <= 0 || rtt_ms <= 0 || loss < 0 || loss >= 100)
+		usage(argv[0]);
+
+	for (i = 0; i < param_count; i++)
+		replay_param(params[i]);
+	ret = pcc_register();
+	if (ret)
+		return 1;
+	if (stats)
+		static_branch_enable(&pcc_timing);
+	ops = replay_ops(name);
+
+	if (replay) {
+		ret = replay_main(replay, ops, repeats);
+	} else {
+		link.bandwidth = mbps * 1e6 / BITS_PER_BYTE;
+		link.rtt_ns = rtt_ms * 1e6;
+		link.tx_ns = REPLAY_MSS * NSEC_PER_SEC / link.bandwidth;
+		link.buffer = buffer_kb ? buffer_kb * 1000 :
+			      link.bandwidth * link.rtt_ns / NSEC_PER_SEC;
+		link.loss = loss / 100 * 4294967296.0;
+		ret = link_main(&link, flows, ops, seconds, counters, out,
+				min_utilization, min_fairness, max_loss);
+	}
+	if (stats)
+		replay_stats();
+	pcc_unregister();
+	return ret;
+}
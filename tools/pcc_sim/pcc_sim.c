@@ -0,0 +1,496 @@
+/* PCC over recorded links, in userspace.
+ * Flows share a bottleneck whose bandwidth and random loss follow a trace. The
+ * utilities and the decisions are the module's own (src/pcc_core.h): slow
+ * start, pairs of intervals at rate +- epsilon that vote, rate adjustment, and
+ * Vivace's gradient steps. Only sending and receiving the intervals is done
+ * here, like tcp_pcc.c does: pipelined in decision making, waiting for the
+ * results otherwise. Every combination of the swept parameters is a run of its
+ * own, the runs are spread over threads.
+ *
+ * The link is a fluid model, in steps of SIM_STEP_US: the flows' rates fill a
+ * drop tail buffer the link drains at the trace bandwidth, and the loss of a
+ * step is what overflows the buffer plus the trace's random loss. Intervals
+ * last an RTT (base RTT plus queueing delay), and their results are received
+ * an RTT after they ended. There are no acks, so an interval is measured over
+ * the time it was sent, and has no ignored parts.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "kernel.h"
+#include "pcc_core.h"
+
+#define SIM_STEP_US 100
+#define SIM_MSS 1448
+
+#define SIM_LIST_MAX 16
+
+/* From start_ms on, until the next step */
+struct trace_step {
+	u32 start_ms;
+	u64 bandwidth;		/* bytes/sec */
+	u32 loss;		/* in 1/2^PCC_LOSS_SHIFT */
+};
+
+/* What an interval sent, and when its results are received */
+struct sim_interval {
+	double sent;		/* bytes */
+	double lost;
+	u32 elapsed_us;
+	u32 rtt_start;		/* usec */
+	u32 rtt_end;
+	u64 rtt_sum;		/* over its steps */
+	u32 steps;
+	u64 received_us;
+};
+
+struct flow {
+	struct pcc_state state;
+	struct sim_interval intervals[PCC_INTERVALS];
+	u32 send_rate;		/* in PCC_RATE_UNIT bytes/sec */
+	u32 interval_us;	/* of the send interval */
+	u32 min_rtt;
+
+	double delivered;	/* over the measured half of the run */
+	u64 random;
+};
+
+struct sim {
+	struct trace_step *trace;
+	int steps;
+	int flows;
+	u32 duration_ms;
+	u32 rtt_us;
+	double buffer;		/* bytes */
+	bool vivace;
+	bool delay;
+};
+
+struct run {
+	struct pcc_params params;
+	double utilization;
+	double delay_ms;
+	double loss;
+	double fairness;
+};
+
+static struct sim sim;
+static struct run *runs;
+static int runs_count;
+static int next_run;
+
+static u64 sim_random(struct flow *flow)
+{
+	flow->random ^= flow->random << 13;
+	flow->random ^= flow->random >> 7;
+	flow->random ^= flow->random << 17;
+	return flow->random;
+}
+
+/* pcc_start_interval() of tcp_pcc.c. While waiting, the flow sends at its
+ * rate outside of any interval */
+static void sim_start_interval(struct flow *flow, u32 rtt_us)
+{
+	struct pcc_state *s = &flow->state;
+	int slot = PCC_SLOT(s->send_index);
+	struct sim_interval *interval = &flow->intervals[slot];
+
+	flow->send_rate = s->rate;
+	if (s->wait_mode)
+		return;
+
+	if (s->mode == PCC_DECISION_MAKING && !(slot & 1))
+		pcc_setup_pair(s, slot, sim_random(flow) & 1);
+	flow->send_rate = pcc_interval_rate(s, slot);
+	flow->interval_us = rtt_us;
+	memset(interval, 0, sizeof(*interval));
+	interval->rtt_start = rtt_us;
+}
+
+static void sim_next_send_interval(struct flow *flow, u64 now_us, u32 rtt_us)
+{
+	struct pcc_state *s = &flow->state;
+	struct sim_interval *interval = &flow->intervals[PCC_SLOT(s->send_index)];
+
+	interval->rtt_end = rtt_us;
+	interval->received_us = now_us + rtt_us;
+	pcc_next_send_interval(s);
+	sim_start_interval(flow, rtt_us);
+}
+
+/* pcc_calc_utility() of tcp_pcc.c, into flow->state.utility */
+static void sim_calc_utility(struct flow *flow, const struct pcc_params *params,
+			     int slot, u32 *goodput)
+{
+	struct sim_interval *interval = &flow->intervals[slot];
+	u32 rate = pcc_interval_rate(&flow->state, slot);
+	u32 loss_ratio, mean_rtt;
+	s64 gradient, utility;
+
+	*goodput = rate;
+	if (interval->sent <= 0 || !interval->elapsed_us) {
+		flow->state.utility = S32_MIN;
+		return;
+	}
+
+	*goodput = min_t(u64, (interval->sent - interval->lost) *
+			 USEC_PER_SEC / interval->elapsed_us / PCC_RATE_UNIT,
+			 rate);
+	loss_ratio = interval->lost * (1 << PCC_LOSS_SHIFT) / interval->sent;
+	gradient = ((s64)interval->rtt_end - interval->rtt_start) <<
+		   PCC_GRADIENT_SHIFT;
+	gradient = pcc_gradient(gradient / interval->elapsed_us);
+	mean_rtt = interval->rtt_sum / interval->steps;
+
+	utility = pcc_utility(&flow->state, params, rate, *goodput, loss_ratio,
+			      gradient, mean_rtt, flow->min_rtt);
+	flow->state.utility = clamp_t(s64, utility, S32_MIN + 1, S32_MAX);
+}
+
+/* The receive part of __pcc_process_sample() of tcp_pcc.c: decides on the
+ * interval received, and starts the next round when decision making is done */
+static void sim_receive(struct flow *flow, const struct pcc_params *params,
+			u32 rtt_us)
+{
+	struct pcc_state *s = &flow->state;
+	int slot = PCC_SLOT(s->recive_index);
+	struct sim_interval *interval = &flow->intervals[slot];
+	u32 lost = interval->lost / SIM_MSS, segs = interval->sent / SIM_MSS;
+	u32 goodput;
+	s32 prev;
+	s64 step;
+
+	s->recive_index++;
+	prev = s->utility;
+	sim_calc_utility(flow, params, slot, &goodput);
+	switch (s->mode) {
+	case PCC_SLOW_START:
+		pcc_decide_slow_start(s, params, prev, goodput, lost, segs,
+				      U32_MAX);
+		break;
+	case PCC_RATE_ADJUSMENT:
+		pcc_decide_rate_adjusment(s, params, prev, lost, segs, U32_MAX);
+		break;
+	case PCC_DECISION_MAKING:
+		if ((slot & 1) && s->vivace)
+			pcc_vivace_decide(s, slot, prev, U32_MAX, &step);
+		else if (slot & 1)
+			pcc_decide(s, params, slot, prev, U32_MAX);
+
+		if (s->mode == PCC_DECISION_MAKING &&
+		    (pcc_pipelined(s) || (slot + 1) % pcc_round_intervals(s))) {
+			if (pcc_resume(s))
+				sim_start_interval(flow, rtt_us);
+			return;
+		}
+	default:
+		break;
+	}
+	pcc_reset_intervals(s);
+	sim_start_interval(flow, rtt_us);
+}
+
+/* Results are received in the order the intervals were sent, the one being
+ * sent can't be yet */
+static bool sim_received(struct flow *flow, u64 now_us)
+{
+	struct pcc_state *s = &flow->state;
+
+	return ((s->send_index - s->recive_index) & PCC_INDEX_MASK) &&
+	       flow->intervals[PCC_SLOT(s->recive_index)].received_us <= now_us;
+}
+
+/* Steps only go forward, so the search goes on from the step of the last
+ * call, kept in *cursor */
+static const struct trace_step *sim_trace_at(u32 ms, int *cursor)
+{
+	int i = *cursor;
+
+	while (i + 1 < sim.steps && sim.trace[i + 1].start_ms <= ms)
+		i++;
+	*cursor = i;
+	return &sim.trace[i];
+}
+
+static void sim_run(struct run *run, int index)
+{
+	struct flow *flows = calloc(sim.flows, sizeof(*flows));
+	u64 steps = (u64)sim.duration_ms * 1000 / SIM_STEP_US, step;
+	double queue = 0, capacity = 0, delivered = 0, sent = 0, lost = 0;
+	double delay = 0, sum = 0, sum_squares = 0;
+	u32 rtt_us = sim.rtt_us;
+	int i, cursor = 0;
+
+	if (!flows) {
+		perror("pcc_sim");
+		exit(1);
+	}
+
+	for (i = 0; i < sim.flows; i++) {
+		pcc_init_state(&flows[i].state, &run->params, sim.vivace,
+			       sim.delay,
+			       run->params.initial_rate >> PCC_RATE_SHIFT,
+			       PCC_SLOW_START);
+		flows[i].min_rtt = rtt_us;
+		flows[i].random = ((u64)index << 32 | i) * 0x9e3779b97f4a7c15ULL
+				  + 1;
+		sim_start_interval(&flows[i], rtt_us);
+	}
+
+	for (step = 0; step < steps; step++) {
+		const struct trace_step *link;
+		double offered = 0, served, dropped = 0, loss;
+		bool measured = step >= steps / 2;
+		u64 now_us = step * SIM_STEP_US;
+
+		link = sim_trace_at(step * SIM_STEP_US / 1000, &cursor);
+		for (i = 0; i < sim.flows; i++)
+			offered += (double)pcc_rate_bytes(flows[i].send_rate) *
+				   SIM_STEP_US / USEC_PER_SEC;
+
+		queue += offered;
+		served = (double)link->bandwidth * SIM_STEP_US / USEC_PER_SEC;
+		if (measured)
+			capacity += served;
+		served = queue < served ? queue : served;
+		queue -= served;
+		if (queue > sim.buffer) {
+			dropped = queue - sim.buffer;
+			queue = sim.buffer;
+		}
+		loss = offered > 0 ? dropped / offered : 0;
+		loss += (1 - loss) * link->loss / (1 << PCC_LOSS_SHIFT);
+		rtt_us = sim.rtt_us + (link->bandwidth ?
+				       queue * USEC_PER_SEC / link->bandwidth :
+				       0);
+
+		for (i = 0; i < sim.flows; i++) {
+			struct flow *flow = &flows[i];
+			struct pcc_state *s = &flow->state;
+			struct sim_interval *interval;
+			double bytes = (double)pcc_rate_bytes(flow->send_rate) *
+				       SIM_STEP_US / USEC_PER_SEC;
+
+			flow->min_rtt = min(flow->min_rtt, rtt_us);
+			if (measured) {
+				flow->delivered += bytes * (1 - loss);
+				sent += bytes;
+				lost += bytes * loss;
+			}
+			if (!s->wait_mode) {
+				interval = &flow->intervals[PCC_SLOT(s->send_index)];
+				interval->sent += bytes;
+				interval->lost += bytes * loss;
+				interval->elapsed_us += SIM_STEP_US;
+				interval->rtt_sum += rtt_us;
+				interval->steps++;
+				if (interval->elapsed_us >= flow->interval_us)
+					sim_next_send_interval(flow, now_us,
+							       rtt_us);
+			}
+			while (sim_received(flow, now_us))
+				sim_receive(flow, &run->params, rtt_us);
+		}
+		if (measured)
+			delay += rtt_us - sim.rtt_us;
+	}
+
+	for (i = 0; i < sim.flows; i++) {
+		delivered += flows[i].delivered;
+		sum += flows[i].delivered;
+		sum_squares += flows[i].delivered * flows[i].delivered;
+	}
+	run->utilization = capacity > 0 ? delivered / capacity : 0;
+	run->delay_ms = delay / (steps - steps / 2) / 1000;
+	run->loss = sent > 0 ? lost / sent : 0;
+	run->fairness = sum_squares > 0 ?
+			sum * sum / (sim.flows * sum_squares) : 0;
+	free(flows);
+}
+
+static void *sim_worker(void *arg)
+{
+	int index;
+
+	while ((index = __atomic_fetch_add(&next_run, 1, __ATOMIC_RELAXED)) <
+	       runs_count)
+		sim_run(&runs[index], index);
+	return NULL;
+}
+
+/* "<ms> <Mbps> <loss %>" lines, # comments */
+static int sim_read_trace(const char *path)
+{
+	double mbps, loss;
+	char line[256];
+	FILE *file;
+	u32 ms;
+
+	file = fopen(path, "r");
+	if (!file) {
+		perror(path);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), file)) {
+		if (line[0] == '#' || sscanf(line, "%u %lf %lf", &ms, &mbps,
+					     &loss) != 3)
+			continue;
+		sim.trace = realloc(sim.trace,
+				    (sim.steps + 1) * sizeof(*sim.trace));
+		if (!sim.trace) {
+			perror("pcc_sim");
+			exit(1);
+		}
+		sim.trace[sim.steps].start_ms = ms;
+		sim.trace[sim.steps].bandwidth = mbps * 1000000 / BITS_PER_BYTE;
+		sim.trace[sim.steps].loss = loss / 100 * (1 << PCC_LOSS_SHIFT);
+		sim.steps++;
+	}
+	fclose(file);
+	if (!sim.steps) {
+		fprintf(stderr, "%s: no steps\n", path);
+		return -1;
+	}
+	return 0;
+}
+
+/* A comma separated list of values to sweep */
+static int sim_parse_list(const char *arg, u32 *list)
+{
+	char *end;
+	int n = 0;
+
+	do {
+		if (n == SIM_LIST_MAX)
+			return -1;
+		list[n++] = strtoul(arg, &end, 0);
+		if (end == arg || (*end && *end != ','))
+			return -1;
+		arg = end + 1;
+	} while (*end);
+	return n;
+}
+
+static bool sim_params_valid(const struct pcc_params *params)
+{
+	return params->epsilon_min &&
+	       params->epsilon_min <= params->epsilon_max &&
+	       params->epsilon_max <= PCC_EPSILON_MAX &&
+	       params->alpha <= pcc_rounding_factor &&
+	       params->loss_margin <= 100;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-f flows] [-t seconds] [-r rtt_ms] [-b buffer_kb] [-j threads]\n"
+		"       [-v | -d] [-e epsilon_min,...] [-E epsilon_max,...] [-m loss_margin,...]\n"
+		"       [-a alpha,...] trace\n", prog);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	u32 eps_min[SIM_LIST_MAX] = { 1 }, eps_max[SIM_LIST_MAX] = { 5 };
+	u32 margin[SIM_LIST_MAX] = { 5 }, alpha[SIM_LIST_MAX] = { 100 };
+	int n_min = 1, n_max = 1, n_margin = 1, n_alpha = 1;
+	int threads = sysconf(_SC_NPROCESSORS_ONLN);
+	int a, b, c, d, i, opt;
+	pthread_t *workers;
+
+	sim.flows = 1;
+	sim.duration_ms = 10000;
+	sim.rtt_us = 30000;
+	sim.buffer = 375 * 1000;
+
+	while ((opt = getopt(argc, argv, "f:t:r:b:j:vde:E:m:a:")) != -1) {
+		switch (opt) {
+		case 'f':
+			sim.flows = atoi(optarg);
+			break;
+		case 't':
+			sim.duration_ms = atof(optarg) * 1000;
+			break;
+		case 'r':
+			sim.rtt_us = atof(optarg) * 1000;
+			break;
+		case 'b':
+			sim.buffer = atof(optarg) * 1000;
+			break;
+		case 'j':
+			threads = atoi(optarg);
+			break;
+		case 'v':
+			sim.vivace = true;
+			break;
+		case 'd':
+			sim.delay = true;
+			break;
+		case 'e':
+			n_min = sim_parse_list(optarg, eps_min);
+			break;
+		case 'E':
+			n_max = sim_parse_list(optarg, eps_max);
+			break;
+		case 'm':
+			n_margin = sim_parse_list(optarg, margin);
+			break;
+		case 'a':
+			n_alpha = sim_parse_list(optarg, alpha);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || sim.flows < 1 || !sim.duration_ms ||
+	    !sim.rtt_us || threads < 1 || n_min < 0 || n_max < 0 ||
+	    n_margin < 0 || n_alpha < 0)
+		usage(argv[0]);
+	if (sim_read_trace(argv[optind]))
+		return 1;
+
+	runs = calloc(n_min * n_max * n_margin * n_alpha, sizeof(*runs));
+	if (!runs) {
+		perror("pcc_sim");
+		return 1;
+	}
+	for (a = 0; a < n_min; a++)
+		for (b = 0; b < n_max; b++)
+			for (c = 0; c < n_margin; c++)
+				for (d = 0; d < n_alpha; d++) {
+					struct pcc_params *params;
+
+					params = &runs[runs_count].params;
+					params->epsilon_min = eps_min[a];
+					params->epsilon_max = eps_max[b];
+					params->loss_margin = margin[c];
+					params->alpha = alpha[d];
+					params->initial_rate = 512 * 1024;
+					if (sim_params_valid(params))
+						runs_count++;
+				}
+
+	pcc_sigmoid_init();
+	pcc_pow2_init();
+
+	workers = calloc(threads, sizeof(*workers));
+	for (i = 0; i < threads; i++)
+		pthread_create(&workers[i], NULL, sim_worker, NULL);
+	for (i = 0; i < threads; i++)
+		pthread_join(workers[i], NULL);
+
+	printf("# epsilon_min epsilon_max loss_margin alpha utilization queue_delay_ms loss fairness\n");
+	for (i = 0; i < runs_count; i++)
+		printf("%u %u %u %u %.4f %.2f %.4f %.4f\n",
+		       runs[i].params.epsilon_min, runs[i].params.epsilon_max,
+		       runs[i].params.loss_margin, runs[i].params.alpha,
+		       runs[i].utilization, runs[i].delay_ms, runs[i].loss,
+		       runs[i].fairness);
+	free(workers);
+	free(runs);
+	free(sim.trace);
+	return 0;
+}